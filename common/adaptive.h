@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Team size of one parallel phase that follows the work left as the objects merge away (en_adaptive). A phase
+// with p threads is modeled as units * unitNs / p + overheadNs * p: the pair loops are split over the threads,
+// while the fork/join and the barriers cost more with every thread. The overhead per thread is measured once
+// with empty parallel regions, the time of one unit of work (a pair) from the last steps of the phase, so the
+// best team is sqrt(units * unitNs / overheadNs) threads
+class AdaptiveThreads {
+    int maxThreads = 1;
+    int current = 1;
+    double overheadNs = 0;
+    double unitNs = 0;
+    bool measured = false;
+    double units = 0;
+    std::chrono::steady_clock::time_point t1;
+    uint64_t phases = 0;
+    uint64_t threadSum = 0;
+public:
+    // Measures the fork/join overhead per thread of a team of up to maxThreads
+    void calibrate(const int threads) {
+        maxThreads = std::max(threads, 1);
+        current = maxThreads;
+        if (maxThreads == 1) {
+            return;
+        }
+        const int repeats = 20;
+        const auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++) {
+#ifdef _OPENMP
+            #pragma omp parallel num_threads(maxThreads)
+            {
+                #pragma omp barrier
+            }
+#endif
+        }
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        overheadNs = elapsed.count() / repeats / maxThreads;
+    }
+
+    // Threads of the next run of the phase, with the given units of work. Starts the clock of the phase
+    int begin(const double work) {
+        units = work;
+        if (measured && overheadNs > 0) {
+            const double best = std::sqrt(units * unitNs / overheadNs);
+            current = (int)std::clamp(std::lround(best), 1L, (long)maxThreads);
+        }
+        phases++;
+        threadSum += current;
+        t1 = std::chrono::steady_clock::now();
+        return current;
+    }
+
+    // Stops the clock and updates the time per unit (the average with the earlier steps, so one slow step
+    // doesn't change the team right away)
+    void end() {
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - t1;
+        if (units <= 0) {
+            return;
+        }
+        const double unit = std::max(elapsed.count() - overheadNs * current, 0.0) * current / units;
+        unitNs = measured ? (unitNs + unit) / 2 : unit;
+        measured = true;
+    }
+
+    // Average team of all runs of the phase
+    double averageThreads() const {
+        return phases > 0 ? (double)threadSum / phases : 0;
+    }
+    int threads() const {
+        return maxThreads;
+    }
+};
+
+// Print the average team of the update and collision phases with en_adaptive
+inline void printAdaptiveThreads(const AdaptiveThreads& updateObj, const AdaptiveThreads& collision) {
+    std::printf("Adaptive threads (of %d): UpdateObj %.1f, Collision %.1f on average\n", updateObj.threads(), updateObj.averageThreads(),
+                collision.averageThreads());
+}
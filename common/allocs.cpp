@@ -0,0 +1,67 @@
+#include "allocs.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef TRACK_ALLOCS
+// Replacements of the global operators. They are in their own source file, so no inlined new/delete pair of an
+// engine is seen together with the malloc/free inside them
+void* operator new(size_t bytes) {
+    allocCount++;
+    allocBytes += bytes;
+    void* memory = std::malloc(bytes > 0 ? bytes : 1);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+void* operator new[](size_t bytes) {
+    return operator new(bytes);
+}
+void* operator new(size_t bytes, std::align_val_t alignment) {
+    allocCount++;
+    allocBytes += bytes;
+    const size_t align = (size_t)alignment;
+#ifdef _WIN32
+    void* memory = _aligned_malloc(bytes > 0 ? bytes : 1, align);
+#else
+    // aligned_alloc needs a multiple of the alignment
+    void* memory = std::aligned_alloc(align, (bytes + align - 1) / align * align + (bytes == 0 ? align : 0));
+#endif
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+void* operator new[](size_t bytes, std::align_val_t alignment) {
+    return operator new(bytes, alignment);
+}
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+void operator delete[](void* memory, size_t) noexcept {
+    std::free(memory);
+}
+void operator delete(void* memory, std::align_val_t) noexcept {
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+void operator delete[](void* memory, std::align_val_t alignment) noexcept {
+    operator delete(memory, alignment);
+}
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept {
+    operator delete(memory, alignment);
+}
+void operator delete[](void* memory, size_t, std::align_val_t alignment) noexcept {
+    operator delete(memory, alignment);
+}
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Heap allocations (operator new) so far. Only counted in builds with TRACK_ALLOCS (cmake -DTRACK_ALLOCS=ON),
+// the replaced operators (allocs.cpp, linked once into every engine) make every allocation a little slower
+inline std::atomic<uint64_t> allocCount{ 0 };
+inline std::atomic<uint64_t> allocBytes{ 0 };
+
+// Allocations made between start and stop, added up over all start/stop pairs (like watch)
+class allocWatch {
+    uint64_t startCount = 0;
+    uint64_t startBytes = 0;
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+public:
+    void start() {
+        startCount = allocCount;
+        startBytes = allocBytes;
+    }
+    void stop() {
+        count += allocCount - startCount;
+        bytes += allocBytes - startBytes;
+    }
+    uint64_t getCount() const {
+        return count;
+    }
+    uint64_t getBytes() const {
+        return bytes;
+    }
+};
+
+// Largest resident set of the process so far, in bytes
+inline uint64_t peakMemory() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    // Linux reports kilobytes, macOS bytes
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// Print the allocations of the phases (only counted with TRACK_ALLOCS) and the peak memory
+inline void printAllocations(const char* const* names, const allocWatch* watches, const size_t phases) {
+#ifdef TRACK_ALLOCS
+    std::printf("Allocations:");
+    for (size_t p = 0; p < phases; p++) {
+        std::printf("%s %s %llu (%.1fKB)", p > 0 ? "," : "", names[p], (unsigned long long)watches[p].getCount(), watches[p].getBytes() / 1024.0);
+    }
+    std::printf(", peak memory %.1fMB\n", peakMemory() / 1048576.0);
+#else
+    (void)names;
+    (void)watches;
+    (void)phases;
+    std::printf("Peak memory %.1fMB\n", peakMemory() / 1048576.0);
+#endif
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Mass and position of the live objects of one step, copied once for all analyses
+struct AnalysisFrame {
+    size_t step = 0;
+    double size_enclosure = 0;
+    std::vector<double> mass, x, y, z;
+
+    size_t size() const {
+        return mass.size();
+    }
+};
+
+// One in-situ analysis: reduces a frame to a few CSV lines of its own file. The buffers are allocated in reserve,
+// so the steps don't allocate (the number of objects only decreases)
+class Analyzer {
+public:
+    virtual ~Analyzer() = default;
+    virtual const char* name() const = 0;
+    virtual const char* header() const = 0;
+    virtual void reserve(size_t n) = 0;
+    virtual void analyze(const AnalysisFrame& frame, std::FILE* file) = 0;
+};
+
+// Radial density profile around the center of mass: objects and mass per spherical shell of equal width, up to
+// the diagonal of the enclosure
+class RadialProfile : public Analyzer {
+    size_t bins;
+    std::vector<int> binOf;
+    std::vector<double> count, shellMass;
+public:
+    explicit RadialProfile(const size_t bins = 32) : bins(bins) {}
+    const char* name() const override {
+        return "radial";
+    }
+    const char* header() const override {
+        return "step,bin,r_inner,r_outer,objects,mass,density";
+    }
+    void reserve(const size_t n) override {
+        binOf.resize(n);
+        count.resize(bins);
+        shellMass.resize(bins);
+    }
+    void analyze(const AnalysisFrame& frame, std::FILE* file) override {
+        const int n = (int)frame.size();
+        double totalMass = 0, cx = 0, cy = 0, cz = 0;
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) reduction(+ : totalMass, cx, cy, cz) if (!omp_in_parallel())
+#endif
+        for (int i = 0; i < n; i++) {
+            totalMass += frame.mass[i];
+            cx += frame.mass[i] * frame.x[i];
+            cy += frame.mass[i] * frame.y[i];
+            cz += frame.mass[i] * frame.z[i];
+        }
+        if (totalMass > 0) {
+            cx /= totalMass;
+            cy /= totalMass;
+            cz /= totalMass;
+        }
+        const double width = frame.size_enclosure * std::sqrt(3.0) / bins;
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) if (!omp_in_parallel())
+#endif
+        for (int i = 0; i < n; i++) {
+            const double r = std::sqrt((frame.x[i] - cx) * (frame.x[i] - cx) + (frame.y[i] - cy) * (frame.y[i] - cy) + (frame.z[i] - cz) * (frame.z[i] - cz));
+            binOf[i] = width > 0 ? std::min((int)(r / width), (int)bins - 1) : 0;
+        }
+        std::fill(count.begin(), count.end(), 0);
+        std::fill(shellMass.begin(), shellMass.end(), 0);
+        for (int i = 0; i < n; i++) {
+            count[binOf[i]]++;
+            shellMass[binOf[i]] += frame.mass[i];
+        }
+        for (size_t b = 0; b < bins; b++) {
+            const double inner = b * width;
+            const double outer = (b + 1) * width;
+            const double volume = 4.0 / 3.0 * 3.14159265358979323846 * (outer * outer * outer - inner * inner * inner);
+            std::fprintf(file, "%zu,%zu,%.6e,%.6e,%.0f,%.6e,%.6e\n", frame.step, b, inner, outer, count[b], shellMass[b],
+                         volume > 0 ? shellMass[b] / volume : 0.0);
+        }
+    }
+};
+
+// Mass spectrum: objects and mass per quarter decade of mass, only the bins that have objects
+class MassSpectrum : public Analyzer {
+    static const int binsPerDecade = 4;
+    static const int maxBins = 4 * 80;
+    std::vector<int> binOf;
+    std::vector<double> count, binMass;
+public:
+    const char* name() const override {
+        return "spectrum";
+    }
+    const char* header() const override {
+        return "step,mass_lo,mass_hi,objects,mass";
+    }
+    void reserve(const size_t n) override {
+        binOf.resize(n);
+        count.resize(maxBins);
+        binMass.resize(maxBins);
+    }
+    void analyze(const AnalysisFrame& frame, std::FILE* file) override {
+        const int n = (int)frame.size();
+        if (n == 0) {
+            return;
+        }
+        double minMass = frame.mass[0];
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) reduction(min : minMass) if (!omp_in_parallel())
+#endif
+        for (int i = 0; i < n; i++) {
+            minMass = std::min(minMass, frame.mass[i]);
+        }
+        const double first = std::floor(std::log10(std::max(minMass, 1e-300)) * binsPerDecade);
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) if (!omp_in_parallel())
+#endif
+        for (int i = 0; i < n; i++) {
+            const double bin = std::floor(std::log10(std::max(frame.mass[i], 1e-300)) * binsPerDecade) - first;
+            binOf[i] = (int)std::min(bin, maxBins - 1.0);
+        }
+        std::fill(count.begin(), count.end(), 0);
+        std::fill(binMass.begin(), binMass.end(), 0);
+        for (int i = 0; i < n; i++) {
+            count[binOf[i]]++;
+            binMass[binOf[i]] += frame.mass[i];
+        }
+        for (int b = 0; b < maxBins; b++) {
+            if (count[b] > 0) {
+                std::fprintf(file, "%zu,%.6e,%.6e,%.0f,%.6e\n", frame.step, std::pow(10.0, (first + b) / binsPerDecade),
+                             std::pow(10.0, (first + b + 1) / binsPerDecade), count[b], binMass[b]);
+            }
+        }
+    }
+};
+
+// The heaviest objects (the bodies that merged the most) with their position
+class LargestBodies : public Analyzer {
+    size_t top;
+    std::vector<size_t> order;
+public:
+    explicit LargestBodies(const size_t top = 10) : top(top) {}
+    const char* name() const override {
+        return "largest";
+    }
+    const char* header() const override {
+        return "step,rank,index,mass,x,y,z";
+    }
+    void reserve(const size_t n) override {
+        order.reserve(n);
+    }
+    void analyze(const AnalysisFrame& frame, std::FILE* file) override {
+        order.resize(frame.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        const size_t count = std::min(top, order.size());
+        std::partial_sort(order.begin(), order.begin() + count, order.end(), [&](size_t a, size_t b) {
+            return frame.mass[a] > frame.mass[b] || (frame.mass[a] == frame.mass[b] && a < b);
+        });
+        for (size_t rank = 0; rank < count; rank++) {
+            const size_t i = order[rank];
+            std::fprintf(file, "%zu,%zu,%zu,%.6e,%.6e,%.6e,%.6e\n", frame.step, rank + 1, i, frame.mass[i], frame.x[i], frame.y[i], frame.z[i]);
+        }
+    }
+};
+
+// Analyzer of a name in analysis_kinds, null if there is none
+inline std::unique_ptr<Analyzer> makeAnalyzer(const std::string& name) {
+    if (name == "radial") {
+        return std::make_unique<RadialProfile>();
+    }
+    if (name == "spectrum") {
+        return std::make_unique<MassSpectrum>();
+    }
+    if (name == "largest") {
+        return std::make_unique<LargestBodies>();
+    }
+    return nullptr;
+}
+
+// In-situ analysis every K steps (analysis=prefix): every analyzer writes a small CSV file prefix_name.csv
+// instead of a full snapshot of the objects. More analyzers can be added with add
+class InSituAnalysis {
+    struct Output {
+        std::unique_ptr<Analyzer> analyzer;
+        std::FILE* file;
+    };
+    std::vector<Output> outputs;
+    AnalysisFrame frame;
+    size_t every = 1;
+    size_t reserved = 0;
+public:
+    InSituAnalysis() = default;
+    InSituAnalysis(const InSituAnalysis&) = delete;
+    InSituAnalysis& operator=(const InSituAnalysis&) = delete;
+    ~InSituAnalysis() {
+        close();
+    }
+
+    // Analyzers of a comma separated list of names (radial, spectrum, largest) for at most n objects. Returns an
+    // error message, empty on success
+    std::string open(const std::string& prefix, const std::string& kinds, const size_t interval, const double size_enclosure, const size_t n) {
+        every = interval;
+        frame.size_enclosure = size_enclosure;
+        frame.mass.reserve(n);
+        frame.x.reserve(n);
+        frame.y.reserve(n);
+        frame.z.reserve(n);
+        reserved = n;
+        std::stringstream list(kinds);
+        std::string name;
+        while (std::getline(list, name, ',')) {
+            std::unique_ptr<Analyzer> analyzer = makeAnalyzer(name);
+            if (analyzer == nullptr) {
+                return "Unknown analysis " + name;
+            }
+            if (!add(std::move(analyzer), prefix + "_" + name + ".csv")) {
+                return "Can't write " + prefix + "_" + name + ".csv";
+            }
+        }
+        return "";
+    }
+
+    // Returns false if the file can't be created
+    bool add(std::unique_ptr<Analyzer> analyzer, const std::string& path) {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (file == nullptr) {
+            return false;
+        }
+        std::fprintf(file, "%s\n", analyzer->header());
+        std::fflush(file);
+        analyzer->reserve(reserved);
+        outputs.push_back({ std::move(analyzer), file });
+        return true;
+    }
+
+    bool isOpen() const {
+        return !outputs.empty();
+    }
+
+    // Call after the collisions of step (0 for the initial objects). get(i, mass, p) fills in the mass and
+    // position of object i, it is called in parallel
+    template <typename Get>
+    void step(const size_t step, const size_t n, Get get) {
+        if (outputs.empty() || step % every != 0) {
+            return;
+        }
+        frame.step = step;
+        frame.mass.resize(n);
+        frame.x.resize(n);
+        frame.y.resize(n);
+        frame.z.resize(n);
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) if (!omp_in_parallel())
+#endif
+        for (int i = 0; i < (int)n; i++) {
+            double p[3];
+            get(i, frame.mass[i], p);
+            frame.x[i] = p[0];
+            frame.y[i] = p[1];
+            frame.z[i] = p[2];
+        }
+        for (Output& output : outputs) {
+            output.analyzer->analyze(frame, output.file);
+            std::fflush(output.file);
+        }
+    }
+
+    // Returns false if a file couldn't be written
+    bool close() {
+        bool ok = true;
+        for (Output& output : outputs) {
+            ok = !std::ferror(output.file) && ok;
+            ok = std::fclose(output.file) == 0 && ok;
+        }
+        outputs.clear();
+        return ok;
+    }
+};
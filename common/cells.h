@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Uniform grid of cells over the enclosure. The objects are sorted into the cells with a counting
+// sort, objects closer than the cell size are always in the same or in neighbouring cells
+class CellList {
+    size_t cellsPerDim = 1;
+    double cellSize = 1;
+    std::vector<size_t> cellStart;    // first entry in cellObjects of every cell (one extra at the end)
+    std::vector<size_t> cellObjects;  // object indices sorted on their cell
+    std::vector<size_t> objectCell;   // cell of every object
+
+    size_t cellCoord(const double p) const {
+        if (p <= 0) {
+            return 0;
+        }
+        return std::min((size_t)(p / cellSize), cellsPerDim - 1);
+    }
+public:
+    // Sort n objects into cells of at least minCellSize wide. The grid never has (much) more
+    // cells than objects, so a small minCellSize only makes the cells emptier, not more numerous
+    template <typename X, typename Y, typename Z>
+    void build(const size_t n, const double size_enclosure, const double minCellSize, X x, Y y, Z z) {
+        const size_t maxCellsPerDim = std::max((size_t)1, (size_t)std::cbrt(8.0 * n));
+        cellsPerDim = minCellSize > 0 ? (size_t)(size_enclosure / minCellSize) : maxCellsPerDim;
+        cellsPerDim = std::clamp(cellsPerDim, (size_t)1, maxCellsPerDim);
+        cellSize = size_enclosure > 0 ? size_enclosure / cellsPerDim : 1;
+
+        const size_t cells = cellsPerDim * cellsPerDim * cellsPerDim;
+        cellStart.assign(cells + 1, 0);
+        cellObjects.resize(n);
+        objectCell.resize(n);
+
+        // Count the objects per cell, then place them in index order
+        for (size_t i = 0; i < n; i++) {
+            objectCell[i] = (cellCoord(z(i)) * cellsPerDim + cellCoord(y(i))) * cellsPerDim + cellCoord(x(i));
+            cellStart[objectCell[i] + 1]++;
+        }
+        for (size_t c = 0; c < cells; c++) {
+            cellStart[c + 1] += cellStart[c];
+        }
+        for (size_t i = 0; i < n; i++) {
+            cellObjects[cellStart[objectCell[i]]++] = i;
+        }
+        // The placement moved every start to the start of the next cell, shift them back
+        for (size_t c = cells; c > 0; c--) {
+            cellStart[c] = cellStart[c - 1];
+        }
+        cellStart[0] = 0;
+    }
+
+    // Calls visit(j) for every object j in the cell of position (px, py, pz) and its neighbours
+    template <typename Visit>
+    void forNeighbours(const double px, const double py, const double pz, Visit visit) const {
+        const size_t cx = cellCoord(px);
+        const size_t cy = cellCoord(py);
+        const size_t cz = cellCoord(pz);
+        const size_t last = cellsPerDim - 1;
+        for (size_t z = cz > 0 ? cz - 1 : 0; z <= std::min(cz + 1, last); z++) {
+            for (size_t y = cy > 0 ? cy - 1 : 0; y <= std::min(cy + 1, last); y++) {
+                const size_t row = (z * cellsPerDim + y) * cellsPerDim;
+                const size_t begin = cellStart[row + (cx > 0 ? cx - 1 : 0)];
+                const size_t end = cellStart[row + std::min(cx + 1, last) + 1];
+                // The neighbouring cells along x are stored next to each other
+                for (size_t k = begin; k < end; k++) {
+                    visit(cellObjects[k]);
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "mapped_file.h"
+
+// Objects as stored in init_config.txt and final_config.txt: a header line
+// "size_enclosure time_step count", followed by one "x y z vx vy vz mass" line per object
+struct Config {
+    double size_enclosure = 0;
+    double time_step = 0;
+    std::vector<double> x, y, z;
+    std::vector<double> vx, vy, vz;
+    std::vector<double> mass;
+
+    size_t size() const {
+        return mass.size();
+    }
+};
+
+namespace config_detail {
+    inline bool isSpace(const char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    // Parse the next number of a line, returns false if there is none
+    inline bool parseNumber(const char*& p, const char* end, double& value) {
+        while (p < end && isSpace(*p)) {
+            p++;
+        }
+        auto result = std::from_chars(p, end, value);
+        if (result.ec != std::errc()) {
+            return false;
+        }
+        p = result.ptr;
+        return true;
+    }
+
+    // Start of the line after position p (or end)
+    inline const char* nextLine(const char* p, const char* end) {
+        while (p < end && *p != '\n') {
+            p++;
+        }
+        return p < end ? p + 1 : end;
+    }
+
+    // True if the line starting at p only contains white space
+    inline bool emptyLine(const char* p, const char* end) {
+        while (p < end && *p != '\n') {
+            if (!isSpace(*p)) {
+                return false;
+            }
+            p++;
+        }
+        return true;
+    }
+}
+
+// Read only the header line of a config file: the enclosure, the time step and the number of objects.
+// Returns an error message, empty on success
+inline std::string loadConfigHeader(const std::string& path, Config& config, size_t& count) {
+    using namespace config_detail;
+
+    std::FILE* file = std::fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return "Can't read " + path;
+    }
+    char line[3 * 320];
+    const bool read = std::fgets(line, sizeof(line), file) != nullptr;
+    std::fclose(file);
+    const char* p = line;
+    const char* end = read ? line + std::char_traits<char>::length(line) : line;
+    double objects = 0;
+    if (!parseNumber(p, end, config.size_enclosure) || !parseNumber(p, end, config.time_step) || !parseNumber(p, end, objects) || objects < 0) {
+        return "Invalid header in " + path;
+    }
+    count = (size_t)objects;
+    return "";
+}
+
+// Read a config file. The file is memory mapped and split in one block of lines per thread,
+// the blocks are counted and parsed in parallel. Returns an error message, empty on success
+inline std::string loadConfig(const std::string& path, Config& config) {
+    using namespace config_detail;
+
+    MappedFile file;
+    if (!file.open(path)) {
+        return "Can't read " + path;
+    }
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    // Header line
+    double count = 0;
+    const char* p = begin;
+    if (!parseNumber(p, end, config.size_enclosure) || !parseNumber(p, end, config.time_step) || !parseNumber(p, end, count)) {
+        return "Invalid header in " + path;
+    }
+    const char* body = nextLine(p, end);
+
+    // Split the lines in blocks, every block starts at the beginning of a line
+#ifdef _OPENMP
+    const int blocks = omp_get_max_threads();
+#else
+    const int blocks = 1;
+#endif
+    std::vector<const char*> blockStart(blocks + 1);
+    for (int b = 0; b < blocks; b++) {
+        const char* start = body + (end - body) * b / blocks;
+        blockStart[b] = (b == 0 || start[-1] == '\n') ? start : nextLine(start, end);
+    }
+    blockStart[blocks] = end;
+
+    // Count the (non empty) lines of every block, the prefix sum gives the first object of every block
+    std::vector<size_t> blockFirst(blocks + 1, 0);
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static, 1)
+#endif
+    for (int b = 0; b < blocks; b++) {
+        size_t lines = 0;
+        for (const char* line = blockStart[b]; line < blockStart[b + 1]; line = nextLine(line, end)) {
+            if (!emptyLine(line, end)) {
+                lines++;
+            }
+        }
+        blockFirst[b + 1] = lines;
+    }
+    for (int b = 0; b < blocks; b++) {
+        blockFirst[b + 1] += blockFirst[b];
+    }
+    const size_t n = blockFirst[blocks];
+    if ((double)n != count) {
+        return path + " has " + std::to_string(n) + " objects, the header says " + std::to_string((size_t)count);
+    }
+
+    config.x.resize(n);
+    config.y.resize(n);
+    config.z.resize(n);
+    config.vx.resize(n);
+    config.vy.resize(n);
+    config.vz.resize(n);
+    config.mass.resize(n);
+
+    // Parse the blocks, remember the first invalid object (if any)
+    size_t invalid = n;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static, 1)
+#endif
+    for (int b = 0; b < blocks; b++) {
+        size_t i = blockFirst[b];
+        for (const char* line = blockStart[b]; line < blockStart[b + 1]; line = nextLine(line, end)) {
+            if (emptyLine(line, end)) {
+                continue;
+            }
+            const char* q = line;
+            if (!(parseNumber(q, end, config.x[i]) && parseNumber(q, end, config.y[i]) && parseNumber(q, end, config.z[i]) &&
+                  parseNumber(q, end, config.vx[i]) && parseNumber(q, end, config.vy[i]) && parseNumber(q, end, config.vz[i]) &&
+                  parseNumber(q, end, config.mass[i]))) {
+#ifdef _OPENMP
+                #pragma omp critical
+#endif
+                invalid = std::min(invalid, i);
+                break;
+            }
+            i++;
+        }
+    }
+    if (invalid != n) {
+        return "Invalid object " + std::to_string(invalid) + " in " + path;
+    }
+    return "";
+}
+
+namespace config_detail {
+    // Append a number as std::fixed << std::setprecision(3) would print it, or exact: the shortest
+    // representation that reads back as the same double
+    inline char* formatNumber(char* p, char* end, const double value, const bool exact = false) {
+        return exact ? std::to_chars(p, end, value).ptr : std::to_chars(p, end, value, std::chars_format::fixed, 3).ptr;
+    }
+}
+
+// Write objects in the config layout, get(i, values) fills in "x y z vx vy vz mass" of object i.
+// Blocks of objects are formatted in parallel with std::to_chars into large buffers, which are written
+// in order with one write per block. The output is the same as the std::fixed << std::setprecision(3)
+// streams, or with exact (en_exact_config) every value at full precision. Returns false if the file can't
+// be written
+template <typename Get>
+bool writeConfig(const std::string& path, const double size_enclosure, const double time_step, const size_t n, Get get, const bool exact = false) {
+    using namespace config_detail;
+
+    // Longest possible line: 7 fixed point doubles (up to 309 digits before the point) and separators
+    const size_t maxLine = 7 * 320;
+    const size_t blockSize = 65536;
+
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    char header[3 * 320];
+    char* h = formatNumber(header, header + sizeof(header), size_enclosure, exact);
+    *h++ = ' ';
+    h = formatNumber(h, header + sizeof(header), time_step, exact);
+    *h++ = ' ';
+    h = std::to_chars(h, header + sizeof(header), n).ptr;
+    *h++ = '\n';
+    bool ok = std::fwrite(header, 1, h - header, file) == (size_t)(h - header);
+
+#ifdef _OPENMP
+    const int threads = omp_get_max_threads();
+#else
+    const int threads = 1;
+#endif
+    std::vector<std::vector<char>> buffers(threads);
+    std::vector<size_t> used(threads);
+
+    // Every round formats one block per thread, then writes them in order
+    for (size_t roundBegin = 0; roundBegin < n && ok; roundBegin += blockSize * threads) {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static, 1)
+#endif
+        for (int b = 0; b < threads; b++) {
+            std::vector<char>& buffer = buffers[b];
+            size_t pos = 0;
+            const size_t begin = std::min(n, roundBegin + b * blockSize);
+            const size_t end = std::min(n, begin + blockSize);
+            for (size_t i = begin; i < end; i++) {
+                if (buffer.size() - pos < maxLine) {
+                    buffer.resize(std::max(2 * buffer.size(), (size_t)1 << 20));
+                }
+                double values[7];
+                get(i, values);
+                char* p = buffer.data() + pos;
+                char* last = buffer.data() + buffer.size();
+                for (int v = 0; v < 7; v++) {
+                    p = formatNumber(p, last, values[v], exact);
+                    *p++ = v < 6 ? ' ' : '\n';
+                }
+                pos = p - buffer.data();
+            }
+            used[b] = pos;
+        }
+        for (int b = 0; b < threads && ok; b++) {
+            ok = std::fwrite(buffers[b].data(), 1, used[b], file) == used[b];
+        }
+    }
+    return std::fclose(file) == 0 && ok;
+}
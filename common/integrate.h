@@ -0,0 +1,55 @@
+#pragma once
+
+#include <algorithm>
+
+// Integration and reflection off the walls of the enclosure [0, size_enclosure] without branches, so the
+// loops over the bodies vectorize. Same results as the if chains (v *= -1 when outside, then clamp)
+
+// Clamps the position with min/max and flips the velocity with a select when it was outside
+inline void reflect(double& p, double& v, const double size_enclosure) {
+    const bool outside = (p < 0) | (p > size_enclosure);
+    v = outside ? -v : v;
+    p = std::min(std::max(p, 0.0), size_enclosure);
+}
+
+// SoA pass over one coordinate of the bodies [begin, end): v += f / m * dt, p += v * dt and the reflection
+inline void integrateAxis(const size_t begin, const size_t end, const double* mass, const double* f, double* v, double* p,
+                          const double time_step, const double size_enclosure) {
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (size_t i = begin; i < end; i++) {
+        v[i] += f[i] / mass[i] * time_step;
+        p[i] += v[i] * time_step;
+        reflect(p[i], v[i], size_enclosure);
+    }
+}
+
+// SoA pass over one coordinate when the velocities are already updated: p += v * dt and the reflection
+inline void moveAxis(const size_t begin, const size_t end, double* v, double* p, const double time_step, const double size_enclosure) {
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (size_t i = begin; i < end; i++) {
+        p[i] += v[i] * time_step;
+        reflect(p[i], v[i], size_enclosure);
+    }
+}
+
+// AoS pass over the bodies [begin, end) with the arrays p[3], v[3], f[3] and mass. The forces are cleared for
+// the next step
+template <typename Body>
+inline void integrateBodies(const size_t begin, const size_t end, Body* bodies, const double time_step, const double size_enclosure) {
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (size_t i = begin; i < end; i++) {
+        Body& body = bodies[i];
+        for (int dim = 0; dim < 3; dim++) {
+            body.v[dim] += body.f[dim] / body.mass * time_step;
+            body.f[dim] = 0;
+            body.p[dim] += body.v[dim] * time_step;
+            reflect(body.p[dim], body.v[dim], size_enclosure);
+        }
+    }
+}
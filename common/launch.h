@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#else
+#include <sys/wait.h>
+#endif
+
+// Running the sim-* executables from the tools (sim-tune, sim-validate)
+
+inline std::string quote(const std::string& arg) {
+    return "\"" + arg + "\"";
+}
+
+// Path of sim-engine in directory
+inline std::filesystem::path engineExecutable(const std::filesystem::path& directory, const std::string& engine) {
+#ifdef _WIN32
+    return directory / ("sim-" + engine + ".exe");
+#else
+    return directory / ("sim-" + engine);
+#endif
+}
+
+// OpenMP threads of the engines started after this
+inline void setThreads(const int threads) {
+#ifdef _WIN32
+    _putenv_s("OMP_NUM_THREADS", std::to_string(threads).c_str());
+#else
+    setenv("OMP_NUM_THREADS", std::to_string(threads).c_str(), 1);
+#endif
+}
+
+// cmd.exe strips the outer quotes of a command that starts with a quoted path
+inline std::string shellCommand(const std::string& command) {
+#ifdef _WIN32
+    return "\"" + command + "\"";
+#else
+    return command;
+#endif
+}
+
+// Exit code of the program from the status of std::system or pclose
+inline int exitCode(const int status) {
+#ifdef _WIN32
+    return status;
+#else
+    return WIFEXITED(status) ? (signed char)WEXITSTATUS(status) : -1;
+#endif
+}
+
+// Runs command with the output in output (the error messages are discarded when output is null),
+// returns the exit code of the engine
+inline int runCapture(const std::string& command, std::string* output = nullptr) {
+    std::FILE* pipe = popen(shellCommand(command + (output == nullptr ? " 2>&1" : "")).c_str(), "r");
+    if (pipe == nullptr) {
+        return -1;
+    }
+    char buffer[4096];
+    size_t bytes;
+    while ((bytes = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+        if (output != nullptr) {
+            output->append(buffer, bytes);
+        }
+    }
+    return exitCode(pclose(pipe));
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <omp.h>
+
+#include "storage.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+#define NUMA_PAGE_SIZE 4096
+
+// Memory placement settings, set once at startup before the bodies are allocated
+struct NumaSettings {
+    // Touch the memory of new allocations in parallel (en_numa)
+    bool firstTouch = false;
+    // Ask the kernel for transparent huge pages (en_hugepages, Linux only)
+    bool hugePages = false;
+};
+inline NumaSettings numaSettings;
+
+// Write one byte of every page in parallel, with the same static partition the per-object loops use.
+// Linux places a page on the socket of the thread that touches it first
+inline void firstTouch(void* memory, const size_t bytes) {
+    char* c = (char*)memory;
+    const long long pages = (long long)((bytes + NUMA_PAGE_SIZE - 1) / NUMA_PAGE_SIZE);
+    #pragma omp parallel for schedule(static)
+    for (long long page = 0; page < pages; page++) {
+        c[page * NUMA_PAGE_SIZE] = 0;
+    }
+}
+
+// Allocator for the body arrays, memory is page aligned so it can be placed per page
+// (or is a memory mapped file with storage=dir). The allocator keeps the storage directory of the time
+// it was made, so a block is always freed the way it was allocated, whatever storageSettings says by then.
+// Allocators of different directories are not equal, moves and swaps of a container take the allocator along
+template <typename T>
+struct NumaAllocator {
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    // Empty: normal memory
+    std::string directory = storageSettings.directory;
+
+    NumaAllocator() = default;
+    template <typename U>
+    NumaAllocator(const NumaAllocator<U>& other) : directory(other.directory) {}
+
+    T* allocate(const size_t n) {
+        const size_t bytes = n * sizeof(T);
+        if (!directory.empty() && bytes > 0) {
+            void* mapped = storageAllocate(directory, bytes);
+            if (mapped == nullptr) {
+                throw std::bad_alloc();
+            }
+            return (T*)mapped;
+        }
+        void* memory = ::operator new(bytes, std::align_val_t(NUMA_PAGE_SIZE));
+#ifdef __linux__
+        if (numaSettings.hugePages) {
+            madvise(memory, bytes, MADV_HUGEPAGE);
+        }
+#endif
+        if (numaSettings.firstTouch) {
+            firstTouch(memory, bytes);
+        }
+        return (T*)memory;
+    }
+    void deallocate(T* memory, const size_t n) {
+        if (!directory.empty() && n > 0) {
+            storageFree(memory, n * sizeof(T));
+            return;
+        }
+        ::operator delete(memory, std::align_val_t(NUMA_PAGE_SIZE));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const NumaAllocator<T>& a, const NumaAllocator<U>& b) {
+    return a.directory == b.directory;
+}
+template <typename T, typename U>
+bool operator!=(const NumaAllocator<T>& a, const NumaAllocator<U>& b) {
+    return !(a == b);
+}
+
+template <typename T>
+using numa_vector = std::vector<T, NumaAllocator<T>>;
+
+// Pin every OpenMP thread to its own core. Threads are spread over the physical cores first
+// (socket by socket), the second hardware thread of a core is only used when all cores are taken
+inline void pinThreads() {
+#ifdef __linux__
+    struct Cpu {
+        int id;
+        int package;
+        int core;
+        int sibling;  // 0 for the first hardware thread of a core, 1 for the second, ...
+    };
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return;
+    }
+    std::vector<Cpu> cpus;
+    for (int id = 0; id < CPU_SETSIZE; id++) {
+        if (!CPU_ISSET(id, &allowed)) {
+            continue;
+        }
+        Cpu cpu = { id, 0, id, 0 };
+        std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+        std::ifstream(topology + "physical_package_id") >> cpu.package;
+        std::ifstream(topology + "core_id") >> cpu.core;
+        for (const auto& other : cpus) {
+            if (other.package == cpu.package && other.core == cpu.core) {
+                cpu.sibling++;
+            }
+        }
+        cpus.push_back(cpu);
+    }
+    std::sort(cpus.begin(), cpus.end(), [](const Cpu& a, const Cpu& b) {
+        if (a.sibling != b.sibling) return a.sibling < b.sibling;
+        if (a.package != b.package) return a.package < b.package;
+        return a.core < b.core;
+    });
+    if (cpus.empty()) {
+        return;
+    }
+
+    #pragma omp parallel
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[omp_get_thread_num() % cpus.size()].id, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+#elif defined(_WIN32)
+    #pragma omp parallel
+    {
+        const int cpus = (int)(sizeof(DWORD_PTR) * 8);
+        SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (omp_get_thread_num() % cpus));
+    }
+#endif
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <initializer_list>
+#include <map>
+#include <string>
+
+// Optional arguments given after the five positional ones, either as "name" or as "name=value"
+class Options {
+    std::map<std::string, std::string> values;
+public:
+    Options(int argc, char** argv, int first) {
+        for (int i = first; i < argc; i++) {
+            std::string arg(argv[i]);
+            auto eq = arg.find('=');
+            if (eq == std::string::npos) {
+                values[arg] = "";
+            } else {
+                values[arg.substr(0, eq)] = arg.substr(eq + 1);
+            }
+        }
+    }
+    bool has(const std::string& name) const {
+        return values.count(name) != 0;
+    }
+    std::string get(const std::string& name, const std::string& def = "") const {
+        auto it = values.find(name);
+        return it == values.end() ? def : it->second;
+    }
+    // Returns the first option that is not in the list of known options (empty if all are known)
+    std::string unknown(std::initializer_list<const char*> known) const {
+        for (const auto& value : values) {
+            bool found = false;
+            for (const char* name : known) {
+                if (value.first == name) {
+                    found = true;
+                }
+            }
+            if (!found) {
+                return value.first;
+            }
+        }
+        return "";
+    }
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// Splits the rows of a triangular pair loop over a number of chunks so that every chunk holds
+// about the same number of pairs (a plain split on rows gives the first chunk most of the work).
+// Chunk c covers the rows [row(c), row(c + 1)), with row(0) = 0 and row(chunks) = n
+
+// Pair loop over j < i (collision check): row i has i pairs
+inline size_t lowerTriangleRow(const size_t n, const size_t c, const size_t chunks) {
+    if (c >= chunks) {
+        return n;
+    }
+    // Rows 0 to r - 1 hold r(r - 1) / 2 pairs, which has to be c / chunks of all pairs
+    return (size_t)std::llround(n * std::sqrt((double)c / chunks));
+}
+
+// Pair loop over j > i (force calculation): row i has n - 1 - i pairs, the mirror of the above
+inline size_t upperTriangleRow(const size_t n, const size_t c, const size_t chunks) {
+    return n - lowerTriangleRow(n, chunks - c, chunks);
+}
+
+// Loop over single objects (integration): the split of schedule(static), the first n % chunks chunks get one
+// row more
+inline size_t evenRow(const size_t n, const size_t c, const size_t chunks) {
+    if (c >= chunks) {
+        return n;
+    }
+    return c * (n / chunks) + std::min(c, n % chunks);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Philox4x32-10 counter based random number generator (Salmon et al., "Parallel random numbers:
+// as easy as 1, 2, 3"). Every output block only depends on (key, counter), so object i can be
+// generated from (seed, i) by any thread, in any order, with the same result on every platform
+class Philox {
+    uint32_t key[2];
+
+    static inline uint32_t mulhilo(const uint32_t a, const uint32_t b, uint32_t& hi) {
+        const uint64_t product = (uint64_t)a * b;
+        hi = (uint32_t)(product >> 32);
+        return (uint32_t)product;
+    }
+public:
+    Philox(const uint64_t seed) : key{ (uint32_t)seed, (uint32_t)(seed >> 32) } {}
+
+    // Two 64 bit random numbers for the counter (c0, c1, c2)
+    void block(const uint64_t c0, const uint32_t c1, const uint32_t c2, uint64_t& r0, uint64_t& r1) const {
+        uint32_t ctr[4] = { (uint32_t)c0, (uint32_t)(c0 >> 32), c1, c2 };
+        uint32_t k0 = key[0];
+        uint32_t k1 = key[1];
+        for (int round = 0; round < 10; round++) {
+            uint32_t hi0, hi1;
+            const uint32_t lo0 = mulhilo(0xD2511F53, ctr[0], hi0);
+            const uint32_t lo1 = mulhilo(0xCD9E8D57, ctr[2], hi1);
+            ctr[0] = hi1 ^ ctr[1] ^ k0;
+            ctr[1] = lo1;
+            ctr[2] = hi0 ^ ctr[3] ^ k1;
+            ctr[3] = lo0;
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+        r0 = ((uint64_t)ctr[1] << 32) | ctr[0];
+        r1 = ((uint64_t)ctr[3] << 32) | ctr[2];
+    }
+
+    // Uniform double in [0, 1) from the top 53 bits
+    static inline double uniform(const uint64_t r) {
+        return (r >> 11) * (1.0 / 9007199254740992.0);
+    }
+};
+
+// Natural logarithm with only +, -, *, / and frexp, which are exact or correctly rounded everywhere
+// (std::log may differ in the last bit between C libraries)
+inline double portableLog(const double value) {
+    int exponent;
+    double m = std::frexp(value, &exponent);
+    if (m < 0.70710678118654752440) {
+        m *= 2;
+        exponent--;
+    }
+    // m is in [sqrt(1/2), sqrt(2)): ln(m) = 2 * (t + t^3/3 + t^5/5 + ...) with t = (m - 1) / (m + 1) <= 0.172
+    const double t = (m - 1) / (m + 1);
+    const double t2 = t * t;
+    double term = t;
+    double sum = 0;
+    for (int k = 0; k < 14; k++) {
+        sum += term / (2 * k + 1);
+        term *= t2;
+    }
+    // ln(2) split in a part that is exact when multiplied by the exponent, and the rest
+    return 2 * sum + exponent * 6.93147180369123816490e-01 + exponent * 1.90821492927058770002e-10;
+}
+
+// Position (uniform in the enclosure) and mass (normal distribution with mean 1E21 and
+// standard deviation 1E15) of object i, only depending on the seed and i
+inline void philoxObject(const Philox& rng, const uint64_t i, const double size_enclosure, double& x, double& y, double& z, double& mass) {
+    uint64_t r0, r1;
+    rng.block(i, 0, 0, r0, r1);
+    x = Philox::uniform(r0) * size_enclosure;
+    y = Philox::uniform(r1) * size_enclosure;
+    rng.block(i, 1, 0, r0, r1);
+    z = Philox::uniform(r0) * size_enclosure;
+
+    // Marsaglia polar method, every attempt has its own counter
+    for (uint32_t attempt = 0;; attempt++) {
+        rng.block(i, 2, attempt, r0, r1);
+        const double u = 2 * Philox::uniform(r0) - 1;
+        const double v = 2 * Philox::uniform(r1) - 1;
+        const double s = u * u + v * v;
+        if (s > 0 && s < 1) {
+            mass = 1E21 + 1E15 * u * std::sqrt(-2 * portableLog(s) / s);
+            return;
+        }
+    }
+}
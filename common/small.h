@@ -0,0 +1,218 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+
+#include "allocs.h"
+#include "integrate.h"
+#include "telemetry.h"
+#include "trajectory.h"
+
+// Largest number of objects for the fixed-size engine
+const size_t smallMaxObjects = 64;
+
+// Fixed-size engine for small systems, used by sim-aos and sim-soa when there are at most smallMaxObjects
+// objects (unless no_small is given). All attributes live in std::arrays of MaxN elements in one struct: no
+// heap allocations, and the compiler knows that the arrays don't overlap, so the pair loop is vectorized
+// without runtime checks. A merge only moves the few objects after the removed one. The forces of every
+// object are summed in the order of sim-aos, so the results are identical
+template <size_t MaxN>
+struct SmallSystem {
+    // Width of the blocks of the merge check: a fixed trip count, which the compiler unrolls. MaxN is a
+    // multiple of it
+    static constexpr size_t block = 4;
+    static_assert(MaxN % block == 0, "MaxN must be a multiple of the block width");
+
+    size_t size = 0;
+
+    std::array<double, MaxN> mass{};
+
+    std::array<double, MaxN> x{};
+    std::array<double, MaxN> y{};
+    std::array<double, MaxN> z{};
+
+    std::array<double, MaxN> vx{};
+    std::array<double, MaxN> vy{};
+    std::array<double, MaxN> vz{};
+
+    std::array<double, MaxN> fx{};
+    std::array<double, MaxN> fy{};
+    std::array<double, MaxN> fz{};
+
+    // Forces of the pairs (i, j) of the current row
+    std::array<double, MaxN> rowX{};
+    std::array<double, MaxN> rowY{};
+    std::array<double, MaxN> rowZ{};
+
+    // n objects, get(i, values) fills in x, y, z, vx, vy, vz and mass of object i (the config file order)
+    template <typename Get>
+    void load(const size_t n, Get get) {
+        size = n;
+        for (size_t i = 0; i < n; i++) {
+            double values[7];
+            get(i, values);
+            x[i] = values[0];
+            y[i] = values[1];
+            z[i] = values[2];
+            vx[i] = values[3];
+            vy[i] = values[4];
+            vz[i] = values[5];
+            mass[i] = values[6];
+            fx[i] = fy[i] = fz[i] = 0;
+        }
+    }
+
+    // Merge j into i (j < i) and move the objects after j one place down
+    void merge(const size_t i, const size_t j) {
+        mass[i] += mass[j];
+        vx[i] += vx[j];
+        vy[i] += vy[j];
+        vz[i] += vz[j];
+        for (size_t k = j; k + 1 < size; k++) {
+            mass[k] = mass[k + 1];
+            x[k] = x[k + 1];
+            y[k] = y[k + 1];
+            z[k] = z[k + 1];
+            vx[k] = vx[k + 1];
+            vy[k] = vy[k + 1];
+            vz[k] = vz[k + 1];
+            fx[k] = fx[k + 1];
+            fy[k] = fy[k + 1];
+            fz[k] = fz[k + 1];
+        }
+        size--;
+    }
+
+    // One time step: forces, velocity and position of every object, then its collisions with the objects before it.
+    // removed(j) is called before object j merges away
+    template <typename Removed>
+    void step(const double time_step, const double size_enclosure, const double gravity, Removed removed) {
+        for (size_t i = 0; i < size; i++) {
+            const double xi = x[i];
+            const double yi = y[i];
+            const double zi = z[i];
+            const double mi = mass[i];
+
+            // The pairs (i, j > i): the force of every pair goes to the row and is subtracted from j. Without the
+            // running sum of i the pairs don't depend on each other, so the loop is vectorized (sqrt and division
+            // on SIMD registers, -fno-math-errno)
+            for (size_t j = i + 1; j < size; j++) {
+                const double dst = std::sqrt((xi - x[j]) * (xi - x[j]) + (yi - y[j]) * (yi - y[j]) + (zi - z[j]) * (zi - z[j]));
+                const double massGravDist = mi * mass[j] * gravity / (dst * dst * dst);
+                rowX[j] = massGravDist * (x[j] - xi);
+                rowY[j] = massGravDist * (y[j] - yi);
+                rowZ[j] = massGravDist * (z[j] - zi);
+                fx[j] -= rowX[j];
+                fy[j] -= rowY[j];
+                fz[j] -= rowZ[j];
+            }
+
+            // The forces on i are summed in the order of j, as in sim-aos
+            double fxi = fx[i];
+            double fyi = fy[i];
+            double fzi = fz[i];
+            for (size_t j = i + 1; j < size; j++) {
+                fxi += rowX[j];
+                fyi += rowY[j];
+                fzi += rowZ[j];
+            }
+
+            // All forces on i are known: velocity, position and boundary bounce
+            vx[i] += fxi / mi * time_step;
+            vy[i] += fyi / mi * time_step;
+            vz[i] += fzi / mi * time_step;
+            fx[i] = fy[i] = fz[i] = 0;
+            x[i] += vx[i] * time_step;
+            y[i] += vy[i] * time_step;
+            z[i] += vz[i] * time_step;
+            reflect(x[i], vx[i], size_enclosure);
+            reflect(y[i], vy[i], size_enclosure);
+            reflect(z[i], vz[i], size_enclosure);
+
+            // Merge the objects j < i that are closer than 1. Whole blocks without a collision are skipped
+            size_t j = 0;
+            while (j < i) {
+                if (j + block <= i) {
+                    bool any = false;
+                    for (size_t l = 0; l < block; l++) {
+                        const size_t k = j + l;
+                        any |= (x[i] - x[k]) * (x[i] - x[k]) + (y[i] - y[k]) * (y[i] - y[k]) + (z[i] - z[k]) * (z[i] - z[k]) < 1;
+                    }
+                    if (!any) {
+                        j += block;
+                        continue;
+                    }
+                }
+                if ((x[i] - x[j]) * (x[i] - x[j]) + (y[i] - y[j]) * (y[i] - y[j]) + (z[i] - z[j]) * (z[i] - z[j]) < 1) {
+                    removed(j);
+                    merge(i, j);
+                    i--;
+#ifndef NDEBUG
+                    std::printf("Two bodies collided. New mass: %.2E\n", mass[i]);
+#endif
+                } else {
+                    j++;
+                }
+            }
+        }
+    }
+
+    // The time loop of sim-aos and sim-soa: telemetry and trajectory frames as in those engines,
+    // steadyAllocs runs from the second step on
+    void run(const size_t iterations, const double time_step, const double size_enclosure, const double gravity, const size_t trajEvery,
+             TrajectoryWriter& trajectory, Telemetry& telemetry, allocWatch& steadyAllocs) {
+        auto getPosition = [&](size_t i, double* p) {
+            p[0] = x[i];
+            p[1] = y[i];
+            p[2] = z[i];
+        };
+        auto getVelocity = [&](size_t i, double& m, double* v) {
+            m = mass[i];
+            v[0] = vx[i];
+            v[1] = vy[i];
+            v[2] = vz[i];
+        };
+        for (size_t iteration = 0; iteration < iterations; iteration++) {
+            if (iteration == 1) {
+                steadyAllocs.start();
+            }
+            telemetry.startStep(size);
+            step(time_step, size_enclosure, gravity, [&](size_t j) {
+                trajectory.remove(j);
+            });
+
+            // Printing (only in debug)
+#ifndef NDEBUG
+            std::printf("it %d\t  x\t\t  y\t\t  z\n", (int)iteration);
+            for (size_t i = 0; i < size; i++) {
+                std::printf("%04d: p: %.2E \t%.2E \t%.2E\n", (int)i, x[i], y[i], z[i]);
+                std::printf("%04d: v: %.2E \t%.2E \t%.2E\n\n", (int)i, vx[i], vy[i], vz[i]);
+            }
+#endif
+
+            telemetry.endStep(iteration + 1, size, getVelocity);
+            if (trajectory.isOpen() && (iteration + 1) % trajEvery == 0) {
+                trajectory.frame(iteration + 1, size, getPosition);
+            }
+        }
+    }
+};
+
+// Calls run(system) with an empty SmallSystem of the smallest size (8, 16, 32 or 64) that fits n objects
+template <typename Run>
+void withSmallSystem(const size_t n, Run run) {
+    if (n <= 8) {
+        SmallSystem<8> system;
+        run(system);
+    } else if (n <= 16) {
+        SmallSystem<16> system;
+        run(system);
+    } else if (n <= 32) {
+        SmallSystem<32> system;
+        run(system);
+    } else {
+        SmallSystem<smallMaxObjects> system;
+        run(system);
+    }
+}
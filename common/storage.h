@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Out-of-core storage: with storage=dir every body array is a memory mapped file in dir, so the
+// OS pages the arrays in and out and N is no longer limited by the RAM. The files are deleted as
+// soon as they are mapped (Windows: when the mapping is closed), nothing is left behind
+struct StorageSettings {
+    std::string directory;  // Empty: arrays in normal memory
+};
+inline StorageSettings storageSettings;
+
+#define STORAGE_PAGE_SIZE 4096
+
+// Map a new (zero filled) file of bytes in directory, nullptr if that fails
+inline void* storageAllocate(const std::string& directory, const size_t bytes) {
+    static std::atomic<unsigned> fileCount{ 0 };
+#ifdef _WIN32
+    std::string path = directory + "\\ca-sim-" + std::to_string(GetCurrentProcessId()) + "-" + std::to_string(fileCount++) + ".bin";
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_NEW,
+                              FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)bytes >> 32), (DWORD)bytes, nullptr);
+    void* memory = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes) : nullptr;
+    // The view keeps the mapping and the file open
+    if (mapping != nullptr) {
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    return memory;
+#else
+    std::string path = directory + "/ca-sim-" + std::to_string(getpid()) + "-" + std::to_string(fileCount++) + "-XXXXXX";
+    int fd = mkstemp(path.data());
+    if (fd < 0) {
+        return nullptr;
+    }
+    unlink(path.c_str());
+    void* memory = nullptr;
+    if (ftruncate(fd, (off_t)bytes) == 0) {
+        memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            memory = nullptr;
+        }
+    }
+    close(fd);
+    return memory;
+#endif
+}
+
+inline void storageFree(void* memory, const size_t bytes) {
+#ifdef _WIN32
+    (void)bytes;
+    UnmapViewOfFile(memory);
+#else
+    munmap(memory, bytes);
+#endif
+}
+
+// Tell the OS a range of an array will be read soon, so it can start reading it from disk
+inline void adviseWillNeed(const void* memory, const size_t bytes) {
+    if (storageSettings.directory.empty() || bytes == 0) {
+        return;
+    }
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range = { (PVOID)memory, bytes };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    // madvise needs a page aligned start
+    const size_t offset = (size_t)memory % STORAGE_PAGE_SIZE;
+    madvise((char*)memory - offset, bytes + offset, MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+// Sweep-and-prune broad phase along one axis. Every body is an interval [lo, hi] on the axis,
+// two bodies can only collide if their intervals overlap. The intervals are kept sorted on lo
+// between steps, as bodies only move v*time_step per iteration the insertion sort is nearly O(N)
+class SweepAndPrune {
+    struct Entry {
+        double lo;
+        double hi;
+        size_t index;
+    };
+    std::vector<Entry> entries;
+    std::vector<size_t> shift;
+public:
+    // Refresh the intervals of all n bodies and restore the sort order
+    template <typename Lower, typename Upper>
+    void update(const size_t n, Lower lower, Upper upper) {
+        if (entries.size() != n) {
+            // First call (or the bodies changed behind our back), build the order from scratch. The shifts of
+            // remove get their room here too, so the steps don't allocate (the number of bodies only decreases)
+            entries.resize(n);
+            shift.resize(n);
+            for (size_t i = 0; i < n; i++) {
+                entries[i] = { lower(i), upper(i), i };
+            }
+            std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+                return a.lo < b.lo;
+            });
+            return;
+        }
+        for (auto& e : entries) {
+            e.lo = lower(e.index);
+            e.hi = upper(e.index);
+        }
+        // Insertion sort, the entries are still (almost) sorted from the previous step
+        for (size_t k = 1; k < n; k++) {
+            Entry e = entries[k];
+            size_t m = k;
+            while (m > 0 && entries[m - 1].lo > e.lo) {
+                entries[m] = entries[m - 1];
+                m--;
+            }
+            entries[m] = e;
+        }
+    }
+
+    // Calls found(i, j) with j < i for every pair of overlapping intervals. Run by every thread
+    // of the team, the pairs are only complete after the next barrier
+    template <typename Found>
+    void findPairs(Found found) {
+        const int n = (int)entries.size();
+        #pragma omp for schedule(guided) nowait
+        for (int k = 0; k < n; k++) {
+            for (int m = k + 1; m < n && entries[m].lo <= entries[k].hi; m++) {
+                size_t a = entries[k].index;
+                size_t b = entries[m].index;
+                found(std::max(a, b), std::min(a, b));
+            }
+        }
+    }
+
+    // Drop the bodies for which removed(i) is true and shift the remaining indices down,
+    // the same way the engine compacts its arrays (the relative order stays sorted)
+    template <typename Removed>
+    void remove(Removed removed) {
+        const size_t n = entries.size();
+        shift.resize(n);
+        size_t count = 0;
+        for (size_t i = 0; i < n; i++) {
+            shift[i] = count;
+            if (removed(i)) {
+                count++;
+            }
+        }
+        entries.erase(
+            std::remove_if(
+                entries.begin(),
+                entries.end(),
+                [&](const Entry& e) -> bool {
+                    return removed(e.index);
+                }),
+            entries.end());
+        for (auto& e : entries) {
+            e.index -= shift[e.index];
+        }
+    }
+};
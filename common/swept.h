@@ -0,0 +1,21 @@
+#pragma once
+
+#include <algorithm>
+
+// Swept collision test: both bodies move in a straight line from their position at the start of the step to
+// the one at the end, so a pair that passes through each other within one step is still found. r is the
+// difference of the start positions and d the difference of the displacements (end - start) of the two bodies.
+// True if their distance is below sqrt(limitSqr) at some moment of the step
+inline bool sweptCollision(const double rx, const double ry, const double rz,
+                           const double dx, const double dy, const double dz, const double limitSqr) {
+    // Closest approach of r + t * d for t in [0, 1]
+    const double dd = dx * dx + dy * dy + dz * dz;
+    double t = 0;
+    if (dd > 0) {
+        t = std::clamp(-(rx * dx + ry * dy + rz * dz) / dd, 0.0, 1.0);
+    }
+    const double cx = rx + t * dx;
+    const double cy = ry + t * dy;
+    const double cz = rz + t * dz;
+    return cx * cx + cy * cy + cz * cz < limitSqr;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Quantities that only change by merges and wall bounces, summed over all objects
+struct Totals {
+    double px = 0;
+    double py = 0;
+    double pz = 0;
+    double kineticEnergy = 0;
+    // Sum of m|v|, the scale of the momentum sums (which cancel to about 0)
+    double absMomentum = 0;
+};
+
+// get(i, mass, v) fills in the mass and velocity of object i. Parallel reduction when called outside
+// of a parallel region
+template <typename Get>
+Totals sumTotals(const size_t n, Get get) {
+    double px = 0, py = 0, pz = 0, kineticEnergy = 0, absMomentum = 0;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) reduction(+ : px, py, pz, kineticEnergy, absMomentum) if (!omp_in_parallel())
+#endif
+    for (int i = 0; i < (int)n; i++) {
+        double mass;
+        double v[3];
+        get(i, mass, v);
+        px += mass * v[0];
+        py += mass * v[1];
+        pz += mass * v[2];
+        kineticEnergy += 0.5 * mass * (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        absMomentum += mass * std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    }
+    Totals totals;
+    totals.px = px;
+    totals.py = py;
+    totals.pz = pz;
+    totals.kineticEnergy = kineticEnergy;
+    totals.absMomentum = absMomentum;
+    return totals;
+}
+
+// One CSV line every K steps (telemetry=file): the objects, merges and wall time of that step, the total
+// momentum and kinetic energy, the force pairs per second and the sum of m|v|. Every line is flushed, so a monitor can
+// follow the file (tail -f) while the simulation runs
+class Telemetry {
+    std::FILE* file = nullptr;
+    size_t every = 1;
+    size_t objectsAtStart = 0;
+    std::chrono::high_resolution_clock::time_point stepStart;
+public:
+    Telemetry() = default;
+    Telemetry(const Telemetry&) = delete;
+    Telemetry& operator=(const Telemetry&) = delete;
+    ~Telemetry() {
+        close();
+    }
+
+    // Returns false if the file can't be created
+    bool open(const std::string& path, const size_t interval) {
+        file = std::fopen(path.c_str(), "w");
+        if (file == nullptr) {
+            return false;
+        }
+        every = interval;
+        std::fprintf(file, "step,objects,merges,px,py,pz,kinetic_energy,step_ms,pairs_per_s,abs_momentum\n");
+        std::fflush(file);
+        return true;
+    }
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    // Call before the forces of every step
+    void startStep(const size_t objects) {
+        if (file != nullptr) {
+            objectsAtStart = objects;
+            stepStart = std::chrono::high_resolution_clock::now();
+        }
+    }
+
+    // Call after the collisions of step (1 for the first step). pairs is the number of force pairs of the
+    // step, a negative number means all pairs of the objects at the start of the step
+    template <typename Get>
+    void endStep(const size_t step, const size_t objects, Get get, double pairs = -1) {
+        if (file == nullptr || step % every != 0) {
+            return;
+        }
+        const std::chrono::duration<double, std::milli> stepTime = std::chrono::high_resolution_clock::now() - stepStart;
+        if (pairs < 0) {
+            pairs = objectsAtStart * (objectsAtStart - 1.0) / 2;
+        }
+        const Totals totals = sumTotals(objects, get);
+        std::fprintf(file, "%zu,%zu,%zu,%.6e,%.6e,%.6e,%.6e,%.3f,%.6e,%.6e\n", step, objects, objectsAtStart - objects,
+                     totals.px, totals.py, totals.pz, totals.kineticEnergy, stepTime.count(),
+                     stepTime.count() > 0 ? pairs / stepTime.count() * 1000 : 0.0, totals.absMomentum);
+        std::fflush(file);
+    }
+
+    void close() {
+        if (file != nullptr) {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+};
+
+// Lines of a telemetry file as numbers in the order of the header, without the header
+inline std::vector<std::vector<double>> readTelemetry(const std::string& path) {
+    std::vector<std::vector<double>> lines;
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+        std::stringstream fields(line);
+        std::string field;
+        lines.emplace_back();
+        while (std::getline(fields, field, ',')) {
+            lines.back().push_back(std::stod(field));
+        }
+    }
+    return lines;
+}
@@ -0,0 +1,361 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "mapped_file.h"
+
+// Compact trajectory file (traj=file). The positions are quantized to a grid of 2^bits - 1 steps over
+// the enclosure, a keyframe stores them as they are and the frames in between store the difference with
+// the previous frame (zigzag varints, a few bytes per object for slow objects). Objects that merged into
+// another one since the previous frame are stored as removal events, the indices of the other objects
+// shift down as in the engines. An index at the end of the file gives the offset of every frame.
+//
+// Layout (little endian):
+//   header   "CATRAJ01", u32 bits, u32 keyframe interval, f64 size_enclosure, f64 time_step
+//   frame    u8 keyframe, varint step, varint objects, varint events, varint removed index per event,
+//            varint payload bytes, payload: varint x, y, z per object (keyframe) or zigzag deltas
+//   index    u64 step and u64 offset per frame
+//   footer   u64 frames, u64 index offset, "CATRIDX1"
+namespace trajectory_detail {
+    const char headerMagic[8] = { 'C', 'A', 'T', 'R', 'A', 'J', '0', '1' };
+    const char footerMagic[8] = { 'C', 'A', 'T', 'R', 'I', 'D', 'X', '1' };
+    const size_t headerSize = 32;
+    const size_t footerSize = 24;
+
+    inline void putVarint(std::vector<char>& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back((char)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((char)value);
+    }
+
+    // Returns false if the varint runs past end
+    inline bool getVarint(const char*& p, const char* end, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+            const uint8_t byte = (uint8_t)*p++;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (byte < 0x80) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline uint64_t zigzag(const int64_t value) {
+        return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    }
+    inline int64_t unzigzag(const uint64_t value) {
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    template <typename T>
+    inline void putRaw(std::vector<char>& out, const T value) {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+    template <typename T>
+    inline T getRaw(const char* p) {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        return value;
+    }
+}
+
+class TrajectoryWriter {
+    std::FILE* file = nullptr;
+    uint32_t bits = 20;
+    uint32_t keyframeEvery = 100;
+    double scale = 0;                       // grid steps per unit of length
+    uint64_t offset = 0;                    // bytes written so far
+    std::vector<uint32_t> previous;         // quantized x, y, z of every object in the previous frame
+    std::vector<uint64_t> removed;          // removal events since the previous frame
+    std::vector<uint64_t> frameSteps, frameOffsets;
+    std::vector<std::vector<char>> buffers; // payload of every block of objects
+    std::vector<char> frameHeader;
+    bool ok = true;
+
+    void write(const std::vector<char>& data) {
+        ok = ok && std::fwrite(data.data(), 1, data.size(), file) == data.size();
+        offset += data.size();
+    }
+public:
+    TrajectoryWriter() = default;
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+    ~TrajectoryWriter() {
+        close();
+    }
+
+    // Room for frames of up to n objects, so the frames don't allocate (the number of objects only decreases).
+    // Returns false if the file can't be created
+    bool open(const std::string& path, const double size_enclosure, const double time_step, const uint32_t quantizationBits, const uint32_t keyframeInterval,
+              const size_t n, const size_t frames) {
+        using namespace trajectory_detail;
+        file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        bits = quantizationBits;
+        keyframeEvery = std::max(keyframeInterval, (uint32_t)1);
+        scale = size_enclosure > 0 ? (double)((1ull << bits) - 1) / size_enclosure : 0;
+
+        std::vector<char> header(headerMagic, headerMagic + 8);
+        putRaw(header, bits);
+        putRaw(header, keyframeEvery);
+        putRaw(header, size_enclosure);
+        putRaw(header, time_step);
+        write(header);
+
+        // A coordinate or its zigzag delta takes at most 5 varint bytes, a removed index at most 10. Block 0 holds
+        // all objects when a frame is added inside a parallel region
+        frameSteps.reserve(frames);
+        frameOffsets.reserve(frames);
+        previous.reserve(3 * n);
+        removed.reserve(n);
+        frameHeader.reserve(10 * (n + 4));
+#ifdef _OPENMP
+        const int blocks = omp_get_max_threads();
+#else
+        const int blocks = 1;
+#endif
+        buffers.resize(blocks);
+        for (int b = 0; b < blocks; b++) {
+            buffers[b].reserve(15 * (b == 0 ? n : n / blocks + 1));
+        }
+        return ok;
+    }
+
+    bool isOpen() const {
+        return file != nullptr;
+    }
+
+    // Object index merged into another one and was removed (index in the objects before the removal)
+    void remove(const size_t index) {
+        if (file != nullptr && !frameOffsets.empty()) {
+            removed.push_back(index);
+        }
+    }
+
+    // Removal of all flagged objects of n in one pass, as a sequence of single removals
+    template <typename Flagged>
+    void removeFlagged(const size_t n, Flagged flagged) {
+        size_t count = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (flagged(i)) {
+                remove(i - count++);
+            }
+        }
+    }
+
+    // Add a frame of n objects, position(i, p) fills in x, y and z of object i. Blocks of objects are
+    // encoded in parallel when called outside of a parallel region
+    template <typename Position>
+    void frame(const uint64_t step, const size_t n, Position position) {
+        using namespace trajectory_detail;
+        if (file == nullptr) {
+            return;
+        }
+
+        // Bring the previous frame to the current indices
+        for (const uint64_t index : removed) {
+            previous.erase(previous.begin() + 3 * index, previous.begin() + 3 * index + 3);
+        }
+        const bool keyframe = frameOffsets.size() % keyframeEvery == 0 || previous.size() != 3 * n;
+        previous.resize(3 * n);
+
+#ifdef _OPENMP
+        const int blocks = omp_in_parallel() ? 1 : omp_get_max_threads();
+#else
+        const int blocks = 1;
+#endif
+        buffers.resize(std::max(buffers.size(), (size_t)blocks));
+        const uint32_t maxValue = (uint32_t)((1ull << bits) - 1);
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static, 1) if (blocks > 1)
+#endif
+        for (int b = 0; b < blocks; b++) {
+            std::vector<char>& buffer = buffers[b];
+            buffer.clear();
+            for (size_t i = n * b / blocks; i < n * (b + 1) / blocks; i++) {
+                double p[3];
+                position(i, p);
+                for (int dim = 0; dim < 3; dim++) {
+                    const double grid = std::round(p[dim] * scale);
+                    const uint32_t value = grid <= 0 ? 0 : grid >= maxValue ? maxValue : (uint32_t)grid;
+                    if (keyframe) {
+                        putVarint(buffer, value);
+                    } else {
+                        putVarint(buffer, zigzag((int64_t)value - previous[3 * i + dim]));
+                    }
+                    previous[3 * i + dim] = value;
+                }
+            }
+        }
+
+        frameSteps.push_back(step);
+        frameOffsets.push_back(offset);
+        std::vector<char>& header = frameHeader;
+        header.clear();
+        header.push_back(keyframe ? 1 : 0);
+        putVarint(header, step);
+        putVarint(header, n);
+        putVarint(header, removed.size());
+        for (const uint64_t index : removed) {
+            putVarint(header, index);
+        }
+        size_t payload = 0;
+        for (int b = 0; b < blocks; b++) {
+            payload += buffers[b].size();
+        }
+        putVarint(header, payload);
+        write(header);
+        for (int b = 0; b < blocks; b++) {
+            write(buffers[b]);
+        }
+        removed.clear();
+    }
+
+    // Write the index and close the file, returns false if anything failed to write
+    bool close() {
+        using namespace trajectory_detail;
+        if (file == nullptr) {
+            return ok;
+        }
+        std::vector<char> index;
+        for (size_t f = 0; f < frameOffsets.size(); f++) {
+            putRaw(index, frameSteps[f]);
+            putRaw(index, frameOffsets[f]);
+        }
+        const uint64_t indexOffset = offset;
+        putRaw(index, (uint64_t)frameOffsets.size());
+        putRaw(index, indexOffset);
+        index.insert(index.end(), footerMagic, footerMagic + 8);
+        write(index);
+        ok = std::fclose(file) == 0 && ok;
+        file = nullptr;
+        return ok;
+    }
+};
+
+// Random access to the frames of a trajectory file, a frame is decoded from the keyframe before it
+class TrajectoryReader {
+    MappedFile file;
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    std::vector<uint64_t> frameSteps, frameOffsets;
+public:
+    uint32_t bits = 0;
+    uint32_t keyframeEvery = 0;
+    double size_enclosure = 0;
+    double time_step = 0;
+
+    // Returns an error message, empty on success
+    std::string open(const std::string& path) {
+        using namespace trajectory_detail;
+        if (!file.open(path)) {
+            return "Can't read " + path;
+        }
+        begin = file.data();
+        end = begin + file.size();
+        if (file.size() < headerSize + footerSize || std::memcmp(begin, headerMagic, 8) != 0 || std::memcmp(end - 8, footerMagic, 8) != 0) {
+            return path + " is not a (complete) trajectory file";
+        }
+        bits = getRaw<uint32_t>(begin + 8);
+        keyframeEvery = getRaw<uint32_t>(begin + 12);
+        size_enclosure = getRaw<double>(begin + 16);
+        time_step = getRaw<double>(begin + 24);
+
+        const uint64_t frames = getRaw<uint64_t>(end - footerSize);
+        const uint64_t indexOffset = getRaw<uint64_t>(end - footerSize + 8);
+        if (indexOffset + frames * 16 + footerSize != file.size()) {
+            return "Invalid index in " + path;
+        }
+        frameSteps.resize(frames);
+        frameOffsets.resize(frames);
+        for (uint64_t f = 0; f < frames; f++) {
+            frameSteps[f] = getRaw<uint64_t>(begin + indexOffset + 16 * f);
+            frameOffsets[f] = getRaw<uint64_t>(begin + indexOffset + 16 * f + 8);
+        }
+        return "";
+    }
+
+    size_t frames() const {
+        return frameOffsets.size();
+    }
+    uint64_t step(const size_t frame) const {
+        return frameSteps[frame];
+    }
+
+    // Decode frame into x, y, z (one triple per object), returns an error message, empty on success
+    std::string read(const size_t frame, std::vector<double>& positions, std::vector<uint64_t>* events = nullptr) const {
+        using namespace trajectory_detail;
+        if (frame >= frames()) {
+            return "No frame " + std::to_string(frame);
+        }
+
+        // Go back to the last keyframe, then apply the frames up to the requested one
+        size_t first = frame;
+        while (first > 0 && *(begin + frameOffsets[first]) == 0) {
+            first--;
+        }
+        std::vector<uint32_t> values;
+        for (size_t f = first; f <= frame; f++) {
+            const char* p = begin + frameOffsets[f];
+            const bool keyframe = *p++ != 0;
+            uint64_t step, n, eventCount, payload;
+            if (!getVarint(p, end, step) || !getVarint(p, end, n) || !getVarint(p, end, eventCount)) {
+                return "Invalid frame " + std::to_string(f);
+            }
+            if (events != nullptr && f == frame) {
+                events->clear();
+            }
+            for (uint64_t e = 0; e < eventCount; e++) {
+                uint64_t index;
+                if (!getVarint(p, end, index)) {
+                    return "Invalid frame " + std::to_string(f);
+                }
+                if (!keyframe && 3 * index + 3 <= values.size()) {
+                    values.erase(values.begin() + 3 * index, values.begin() + 3 * index + 3);
+                }
+                if (events != nullptr && f == frame) {
+                    events->push_back(index);
+                }
+            }
+            if (!getVarint(p, end, payload) || (uint64_t)(end - p) < payload) {
+                return "Invalid frame " + std::to_string(f);
+            }
+            if (!keyframe && values.size() != 3 * n) {
+                return "Frame " + std::to_string(f) + " doesn't match the previous one";
+            }
+            values.resize(3 * n);
+            const char* payloadEnd = p + payload;
+            for (uint64_t k = 0; k < 3 * n; k++) {
+                uint64_t value;
+                if (!getVarint(p, payloadEnd, value)) {
+                    return "Invalid frame " + std::to_string(f);
+                }
+                values[k] = keyframe ? (uint32_t)value : (uint32_t)(values[k] + unzigzag(value));
+            }
+        }
+
+        const double unit = bits > 0 ? size_enclosure / (double)((1ull << bits) - 1) : 0;
+        positions.resize(values.size());
+        for (size_t k = 0; k < values.size(); k++) {
+            positions[k] = values[k] * unit;
+        }
+        return "";
+    }
+};
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <vector>
 
 // Watch class used for easy benchmarking
 class watch {
@@ -22,4 +25,30 @@ public:
     uint64_t getCount() {
         return count;
     }
-};
\ No newline at end of file
+};
+
+// Print the fastest and slowest of a group of per thread watches, to show how well the work is balanced
+inline void printThreadBalance(const char* name, std::vector<watch>& watches) {
+    if (watches.empty()) {
+        return;
+    }
+    uint64_t min = watches[0].getCount();
+    uint64_t max = watches[0].getCount();
+    for (auto& w : watches) {
+        min = std::min(min, w.getCount());
+        max = std::max(max, w.getCount());
+    }
+    std::printf("%s per thread (%zu threads): min %.1fms, max %.1fms\n", name, watches.size(), min / 1000000.0, max / 1000000.0);
+}
+
+// Print the average time per step a thread spent waiting for the others
+inline void printSyncCost(std::vector<watch>& watches, const int steps) {
+    if (watches.empty() || steps <= 0) {
+        return;
+    }
+    uint64_t total = 0;
+    for (auto& w : watches) {
+        total += w.getCount();
+    }
+    std::printf("Synchronization per step: %.1fus (average of %zu threads)\n", total / 1000.0 / watches.size() / steps, watches.size());
+}
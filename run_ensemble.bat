@@ -0,0 +1,3 @@
+set /p arguments=<default_args.txt
+out\build\x64-Release\sim-ensemble.exe %arguments%
+PAUSE
\ No newline at end of file
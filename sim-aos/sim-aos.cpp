@@ -4,6 +4,15 @@
 const double merge_distance = 1;
 bool en_benchmark = false;
 
+// Positions written every traj_every steps (only with traj=file)
+TrajectoryWriter trajectory;
+
+// Conserved quantities and speed every telemetry_every steps (only with telemetry=file)
+Telemetry telemetry;
+
+// Heap allocations of the time loop (only counted with TRACK_ALLOCS), and of all steps after the first one
+allocWatch loopAllocs, steadyAllocs;
+
 // Checks for collisions between object i and objects 0 to i - 1
 void checkCollisions(std::vector<Object>& objects, size_t& i) {
     auto it = objects.begin();
@@ -21,6 +30,7 @@ void checkCollisions(std::vector<Object>& objects, size_t& i) {
 #endif
 
             // Delete second object
+            trajectory.remove(it - objects.begin());
             it = objects.erase(it);
             i--;  // Decrement i, as we just deleted a entry j < i
         }
@@ -37,13 +47,9 @@ int main(int argc, char** argv) {
     const char* arguments[5] = {"num_objects", "num_iterations",
                                 "random_seed", "size_enclosure", "time_step"};
 
-    // If an optional argument is provided and it matches en_benchmark, enable benchmark mode
-    if (argc == 7) {
-        std::string arg6(argv[6]);
-        if (arg6 == "en_benchmark") {
-            en_benchmark = true;
-        }
-    }
+    // Optional arguments (en_benchmark, init=file, en_philox, en_exact_config, traj=file, traj_every=K, traj_bits=B, traj_keyframe=F, telemetry=file, telemetry_every=K, en_alloc_check, no_small) follow the five positional ones
+    Options options(argc, argv, 6);
+    en_benchmark = options.has("en_benchmark");
     if (!en_benchmark) {
         std::cout << "sim-aos invoked with " << argc - 1 << " parameters."
             << "\n"
@@ -65,16 +71,30 @@ int main(int argc, char** argv) {
     }
 
     // Check the parameter count
-    if (argc < 6 || argc > 7) {
+    if (argc < 6) {
         std::cerr << "Error: Wrong number of parameters\n";
         return -1;
     }
+    std::string unknownOption = options.unknown({"en_benchmark", "init", "en_philox", "en_exact_config", "traj", "traj_every", "traj_bits", "traj_keyframe", "telemetry", "telemetry_every", "en_alloc_check", "no_small"});
+    if (!unknownOption.empty()) {
+        std::cerr << "Error: Unknown option " << unknownOption << "\n";
+        return -1;
+    }
+#ifndef TRACK_ALLOCS
+    if (options.has("en_alloc_check")) {
+        std::cerr << "Error: en_alloc_check needs a build with TRACK_ALLOCS\n";
+        return -1;
+    }
+#endif
 
     const int num_objects = std::stoi(argv[1]);
     const int num_iterations = std::stoi(argv[2]);
     const uint64_t seed = std::stoull(argv[3]);
     const double size_enclosure = std::stod(argv[4]);
     const double time_step = std::stod(argv[5]);
+    const size_t trajEvery = std::stoull(options.get("traj_every", "1"));
+    const int trajBits = std::stoi(options.get("traj_bits", "20"));
+    const size_t telemetryEvery = std::stoull(options.get("telemetry_every", "1"));
 
     if (num_objects < 0) {
         std::cerr << "Error: Invalid number of objects\n";
@@ -95,125 +115,220 @@ int main(int argc, char** argv) {
         std::cerr << "Error: Invalid time increment\n";
         return -2;
     }
+    if (trajEvery == 0) {
+        std::cerr << "Error: Invalid trajectory interval\n";
+        return -2;
+    }
+    if (trajBits < 1 || trajBits > 32) {
+        std::cerr << "Error: Invalid trajectory precision\n";
+        return -2;
+    }
+    if (telemetryEvery == 0) {
+        std::cerr << "Error: Invalid telemetry interval\n";
+        return -2;
+    }
 
-    // Initialize the RNG
-    std::mt19937_64 gen(seed);
-    std::uniform_real_distribution<> uniform_distr(0, size_enclosure);
-    std::normal_distribution<double> normal_distr(1E21, 1E15);
+    // Read the objects from the init file, or generate them with random mass and position
+    std::vector<Object> objects;
+    if (options.has("init")) {
+        Config config;
+        std::string error = loadConfig(options.get("init"), config);
+        if (!error.empty()) {
+            std::cerr << "Error: " << error << "\n";
+            return -3;
+        }
+        objects.resize(config.size());
+        for (size_t i = 0; i < config.size(); i++) {
+            objects[i] = Object(config.mass[i], config.x[i], config.y[i], config.z[i]);
+            objects[i].vx = config.vx[i];
+            objects[i].vy = config.vy[i];
+            objects[i].vz = config.vz[i];
+        }
+    } else if (options.has("en_philox")) {
+        // Every object only depends on (seed, i), so they can be generated in any order
+        Philox rng(seed);
+        objects.resize(num_objects);
+        for (int i = 0; i < num_objects; i++) {
+            double x, y, z, m;
+            philoxObject(rng, i, size_enclosure, x, y, z, m);
+            objects[i] = Object(m, x, y, z);
+        }
+    } else {
+        // Initialize the RNG
+        std::mt19937_64 gen(seed);
+        std::uniform_real_distribution<> uniform_distr(0, size_enclosure);
+        std::normal_distribution<double> normal_distr(1E21, 1E15);
 
-    // Create the necessary amount of objects and store them in a vector of class Object
-    std::vector<Object> objects(num_objects);
-    auto rnd_object = [&gen, &uniform_distr, &normal_distr] {
-        double x = uniform_distr(gen);
-        double y = uniform_distr(gen);
-        double z = uniform_distr(gen);
-        double m = normal_distr(gen);
-        return Object(m, x, y, z);
-    };
-    std::generate(objects.begin(), objects.end(), rnd_object);
+        // Create the necessary amount of objects and store them in a vector of class Object
+        objects.resize(num_objects);
+        auto rnd_object = [&gen, &uniform_distr, &normal_distr] {
+            double x = uniform_distr(gen);
+            double y = uniform_distr(gen);
+            double z = uniform_distr(gen);
+            double m = normal_distr(gen);
+            return Object(m, x, y, z);
+        };
+        std::generate(objects.begin(), objects.end(), rnd_object);
+    }
 
     // Check for collisions before starting
     for (size_t i = 0; i < objects.size(); i++) {
         checkCollisions(objects, i);
     }
 
+    // Values of object i as printed in the config files
+    auto getConfigValues = [&](size_t i, double* values) {
+        values[0] = objects[i].x;
+        values[1] = objects[i].y;
+        values[2] = objects[i].z;
+        values[3] = objects[i].vx;
+        values[4] = objects[i].vy;
+        values[5] = objects[i].vz;
+        values[6] = objects[i].mass;
+    };
+
     // Print the initial config
-    std::ofstream initial;
-    initial.open("init_config.txt");
-    initial << std::fixed << std::setprecision(3) << size_enclosure << " " << time_step << " " << objects.size() << "\n";
-    for (const auto& i : objects) {
-        initial << std::fixed << std::setprecision(3) << i.x << " " << i.y << " " << i.z << " " << i.vx << " " << i.vy << " " << i.vz << " " << i.mass << "\n";
+    if (!writeConfig("init_config.txt", size_enclosure, time_step, objects.size(), getConfigValues, options.has("en_exact_config"))) {
+        std::cerr << "Error: Can't write init_config.txt\n";
+        return -3;
     }
-    initial.close();
 
-    // Time loop
-    for (size_t iteration = 0; iteration < (unsigned) num_iterations; iteration++) {  
-
-        // Calculate the force, change in velocity and position for every object
-        for (size_t i = 0; i < objects.size(); i++) {
-            const size_t objectsSize = objects.size();
-            for (size_t j = i + 1; j < objectsSize; j++) {
-                double massGravDist = objects[i].mass * objects[j].mass * G / dst_cube(objects[i], objects[j]);
-                double fx = massGravDist * (objects[j].x - objects[i].x);
-                double fy = massGravDist * (objects[j].y - objects[i].y);
-                double fz = massGravDist * (objects[j].z - objects[i].z);
-                objects[i].fx += fx;
-                objects[j].fx -= fx;
-                objects[i].fy += fy;
-                objects[j].fy -= fy;
-                objects[i].fz += fz;
-                objects[j].fz -= fz;
-            }
+    // Start the trajectory with the initial positions, a frame is added after every trajEvery steps
+    auto getPosition = [&](size_t i, double* p) {
+        p[0] = objects[i].x;
+        p[1] = objects[i].y;
+        p[2] = objects[i].z;
+    };
+    if (options.has("traj")) {
+        if (!trajectory.open(options.get("traj"), size_enclosure, time_step, trajBits, std::stoul(options.get("traj_keyframe", "100")),
+                             objects.size(), num_iterations / trajEvery + 1)) {
+            std::cerr << "Error: Can't write " << options.get("traj") << "\n";
+            return -3;
+        }
+        trajectory.frame(0, objects.size(), getPosition);
+    }
 
-            // All forces on objects[i] are now computed, calculate the velocity change
-            // F=ma -> a=F/m
-            // dv=a*dt -> dv=F/m*dt
-            objects[i].vx += objects[i].fx / objects[i].mass * time_step;
-            objects[i].vy += objects[i].fy / objects[i].mass * time_step;
-            objects[i].vz += objects[i].fz / objects[i].mass * time_step;
-
-            // Reset all forces to zero
-            objects[i].fx = objects[i].fy = objects[i].fz = 0;
-
-            // Update the position of the object
-            objects[i].x += objects[i].vx * time_step;
-            objects[i].y += objects[i].vy * time_step;
-            objects[i].z += objects[i].vz * time_step;
-
-            // Check for boundary bounce
-            if (objects[i].x > size_enclosure) {
-                objects[i].x = size_enclosure;
-                objects[i].vx *= -1;
-            }
-            if (objects[i].y > size_enclosure) {
-                objects[i].y = size_enclosure;
-                objects[i].vy *= -1;
+    // Conserved quantities and speed of the time loop
+    auto getVelocity = [&](size_t i, double& mass, double* v) {
+        mass = objects[i].mass;
+        v[0] = objects[i].vx;
+        v[1] = objects[i].vy;
+        v[2] = objects[i].vz;
+    };
+    if (options.has("telemetry") && !telemetry.open(options.get("telemetry"), telemetryEvery)) {
+        std::cerr << "Error: Can't write " << options.get("telemetry") << "\n";
+        return -3;
+    }
+
+    // Small systems run on the fixed-size engine (common/small.h) unless no_small is given
+    const bool small = objects.size() <= smallMaxObjects && !options.has("no_small");
+    if (small && !en_benchmark) {
+        std::cout << "Fixed-size engine for " << objects.size() << " objects\n";
+    }
+
+    // Time loop
+    loopAllocs.start();
+    if (small) {
+        // Fixed-size engine, the objects are copied back after the last step
+        withSmallSystem(objects.size(), [&](auto& system) {
+            system.load(objects.size(), getConfigValues);
+            system.run(num_iterations, time_step, size_enclosure, G, trajEvery, trajectory, telemetry, steadyAllocs);
+            objects.resize(system.size);
+            for (size_t i = 0; i < system.size; i++) {
+                objects[i] = Object(system.mass[i], system.x[i], system.y[i], system.z[i]);
+                objects[i].vx = system.vx[i];
+                objects[i].vy = system.vy[i];
+                objects[i].vz = system.vz[i];
             }
-            if (objects[i].z > size_enclosure) {
-                objects[i].z = size_enclosure;
-                objects[i].vz *= -1;
+        });
+    } else {
+        for (size_t iteration = 0; iteration < (unsigned) num_iterations; iteration++) {  
+            if (iteration == 1) {
+                steadyAllocs.start();
             }
+            telemetry.startStep(objects.size());
+
+            // Calculate the force, change in velocity and position for every object
+            for (size_t i = 0; i < objects.size(); i++) {
+                const size_t objectsSize = objects.size();
+                for (size_t j = i + 1; j < objectsSize; j++) {
+                    double massGravDist = objects[i].mass * objects[j].mass * G / dst_cube(objects[i], objects[j]);
+                    double fx = massGravDist * (objects[j].x - objects[i].x);
+                    double fy = massGravDist * (objects[j].y - objects[i].y);
+                    double fz = massGravDist * (objects[j].z - objects[i].z);
+                    objects[i].fx += fx;
+                    objects[j].fx -= fx;
+                    objects[i].fy += fy;
+                    objects[j].fy -= fy;
+                    objects[i].fz += fz;
+                    objects[j].fz -= fz;
+                }
+
+                // All forces on objects[i] are now computed, calculate the velocity change
+                // F=ma -> a=F/m
+                // dv=a*dt -> dv=F/m*dt
+                objects[i].vx += objects[i].fx / objects[i].mass * time_step;
+                objects[i].vy += objects[i].fy / objects[i].mass * time_step;
+                objects[i].vz += objects[i].fz / objects[i].mass * time_step;
+
+                // Reset all forces to zero
+                objects[i].fx = objects[i].fy = objects[i].fz = 0;
+
+                // Update the position of the object
+                objects[i].x += objects[i].vx * time_step;
+                objects[i].y += objects[i].vy * time_step;
+                objects[i].z += objects[i].vz * time_step;
+
+                // Check for boundary bounce (branchless)
+                reflect(objects[i].x, objects[i].vx, size_enclosure);
+                reflect(objects[i].y, objects[i].vy, size_enclosure);
+                reflect(objects[i].z, objects[i].vz, size_enclosure);
 
-            if (objects[i].x < 0) {
-                objects[i].x = 0;
-                objects[i].vx *= -1;
+                // Check for collisions (for all objects j < i)
+                checkCollisions(objects, i);
             }
-            if (objects[i].y < 0) {
-                objects[i].y = 0;
-                objects[i].vy *= -1;
+
+            // Printing (only in debug)
+#ifndef NDEBUG
+            std::printf("it %d\t  x\t\t  y\t\t  z\n", (int)iteration);
+            unsigned int j = 0;
+            for (const auto& i : objects) {
+                std::printf("%04d: f: %.2E \t%.2E \t%.2E\n", j, i.fx, i.fy, i.fz);
+                std::printf("%04d: p: %.2E \t%.2E \t%.2E\n", j, i.x, i.y, i.z);
+                std::printf("%04d: v: %.2E \t%.2E \t%.2E\n\n", j, i.vx, i.vy, i.vz);
+                j++;
             }
-            if (objects[i].z < 0) {
-                objects[i].z = 0;
-                objects[i].vz *= -1;
+            if (objects.size() > 1)
+                std::printf("Distance (0-1) %.2E\n", std::sqrt(dst_sqr(objects[0], objects[1])));
+#endif
+
+            telemetry.endStep(iteration + 1, objects.size(), getVelocity);
+            if (trajectory.isOpen() && (iteration + 1) % trajEvery == 0) {
+                trajectory.frame(iteration + 1, objects.size(), getPosition);
             }
+        }  // END OF TIME LOOP
+    }
 
-            // Check for collisions (for all objects j < i)
-            checkCollisions(objects, i);
-        }
+    loopAllocs.stop();
 
-        // Printing (only in debug)
-#ifndef NDEBUG
-        std::printf("it %d\t  x\t\t  y\t\t  z\n", (int)iteration);
-        unsigned int j = 0;
-        for (const auto& i : objects) {
-            std::printf("%04d: f: %.2E \t%.2E \t%.2E\n", j, i.fx, i.fy, i.fz);
-            std::printf("%04d: p: %.2E \t%.2E \t%.2E\n", j, i.x, i.y, i.z);
-            std::printf("%04d: v: %.2E \t%.2E \t%.2E\n\n", j, i.vx, i.vy, i.vz);
-            j++;
-        }
-        if (objects.size() > 1)
-            std::printf("Distance (0-1) %.2E\n", std::sqrt(dst_sqr(objects[0], objects[1])));
-#endif
-    }  // END OF TIME LOOP
+    // The steps after the first one must not allocate
+    if (num_iterations > 1) {
+        steadyAllocs.stop();
+    }
+    if (options.has("en_alloc_check") && steadyAllocs.getCount() > 0) {
+        std::cerr << "Error: " << steadyAllocs.getCount() << " heap allocations after the first step\n";
+        return -4;
+    }
 
     // Printing final config
-    std::ofstream final;
-    final.open("final_config.txt");
-    final << std::fixed << std::setprecision(3) << size_enclosure << " " << time_step << " " << objects.size() << "\n";
-    for (const auto& i : objects) {
-        final << std::fixed << std::setprecision(3) << i.x << " " << i.y << " " << i.z << " " << i.vx << " " << i.vy << " " << i.vz << " " << i.mass << "\n";
+    if (!writeConfig("final_config.txt", size_enclosure, time_step, objects.size(), getConfigValues, options.has("en_exact_config"))) {
+        std::cerr << "Error: Can't write final_config.txt\n";
+        return -3;
+    }
+    if (!trajectory.close()) {
+        std::cerr << "Error: Can't write " << options.get("traj") << "\n";
+        return -3;
     }
-    final.close();
 
     // Measure execution time and print it
     auto t2 = std::chrono::high_resolution_clock::now();
@@ -223,6 +338,9 @@ int main(int argc, char** argv) {
     }
     else {
         std::printf("Total execution time was %f ms.\n", exec_ms.count());
+        const char* allocNames[2] = { "Time loop", "after the first step" };
+        const allocWatch allocs[2] = { loopAllocs, steadyAllocs };
+        printAllocations(allocNames, allocs, 2);
     }
 
 
@@ -10,5 +10,13 @@
 #include <vector>
 
 #include "object.h"
+#include "../common/allocs.h"
+#include "../common/config_io.h"
+#include "../common/integrate.h"
+#include "../common/options.h"
+#include "../common/philox.h"
+#include "../common/small.h"
+#include "../common/telemetry.h"
+#include "../common/trajectory.h"
 
 #define G 6.674E-11
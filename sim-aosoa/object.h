@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "../common/config_io.h"
+#include "../common/integrate.h"
+#include "../common/philox.h"
+
+#define sqr(a) (a)*(a)
+#define cube(a) (a)*(a)*(a)
+
+// Objects per block
+#define BLOCK 8
+
+// BLOCK objects with every attribute in its own small array: the lanes of one attribute are contiguous
+// (like SoA) and all attributes of an object are in the same few cache lines (like AoS)
+struct Block {
+	double mass[BLOCK];
+
+	double x[BLOCK];
+	double y[BLOCK];
+	double z[BLOCK];
+
+	double vx[BLOCK];
+	double vy[BLOCK];
+	double vz[BLOCK];
+
+	double fx[BLOCK];
+	double fy[BLOCK];
+	double fz[BLOCK];
+};
+
+struct Object;
+inline double dst_sqr(Object* n, size_t i1, size_t i2);
+inline double dst_cube(Object* n, size_t i1, size_t i2);
+
+struct Object {
+
+	size_t size;
+
+	std::vector <Block> blocks;
+
+	// Attributes of object i
+	inline double& mass(size_t i) { return blocks[i / BLOCK].mass[i % BLOCK]; }
+	inline double& x(size_t i) { return blocks[i / BLOCK].x[i % BLOCK]; }
+	inline double& y(size_t i) { return blocks[i / BLOCK].y[i % BLOCK]; }
+	inline double& z(size_t i) { return blocks[i / BLOCK].z[i % BLOCK]; }
+	inline double& vx(size_t i) { return blocks[i / BLOCK].vx[i % BLOCK]; }
+	inline double& vy(size_t i) { return blocks[i / BLOCK].vy[i % BLOCK]; }
+	inline double& vz(size_t i) { return blocks[i / BLOCK].vz[i % BLOCK]; }
+	inline double& fx(size_t i) { return blocks[i / BLOCK].fx[i % BLOCK]; }
+	inline double& fy(size_t i) { return blocks[i / BLOCK].fy[i % BLOCK]; }
+	inline double& fz(size_t i) { return blocks[i / BLOCK].fz[i % BLOCK]; }
+
+	// Constructor
+	Object(const size_t size, const uint64_t seed, const double size_enclosure, const bool en_philox = false) : size(size),
+		blocks((size + BLOCK - 1) / BLOCK, Block{})
+	{
+		if (en_philox) {
+			// Every object only depends on (seed, i), so they can be generated in any order
+			Philox rng(seed);
+			for (int i = 0; i < (int)size; ++i) {
+				philoxObject(rng, i, size_enclosure, x(i), y(i), z(i), mass(i));
+			}
+			return;
+		}
+
+		// Initialize the RNG
+		std::mt19937_64 gen(seed);
+		std::uniform_real_distribution<> uniform_distr(0, size_enclosure);
+		std::normal_distribution<double> normal_distr(1E21, 1E15);
+
+		// Add the required amount of objects
+		for (size_t i = 0; i < size; ++i) {
+			x(i) = uniform_distr(gen);
+			y(i) = uniform_distr(gen);
+			z(i) = uniform_distr(gen);
+			mass(i) = normal_distr(gen);
+		}
+	}
+
+	// Constructor from the objects of a config file
+	Object(const Config& config) : size(config.size()),
+		blocks((size + BLOCK - 1) / BLOCK, Block{})
+	{
+		for (size_t i = 0; i < size; ++i) {
+			x(i) = config.x[i];
+			y(i) = config.y[i];
+			z(i) = config.z[i];
+			vx(i) = config.vx[i];
+			vy(i) = config.vy[i];
+			vz(i) = config.vz[i];
+			mass(i) = config.mass[i];
+		}
+	}
+
+	// Reset the forces to zero
+	inline void reset_forces() {
+		for (Block& block : blocks) {
+			std::fill(block.fx, block.fx + BLOCK, 0);
+			std::fill(block.fy, block.fy + BLOCK, 0);
+			std::fill(block.fz, block.fz + BLOCK, 0);
+		}
+	}
+
+	// Keep objects inside the boundary (branchless)
+	inline void adjust_for_boundary(const double size_enclosure, const size_t i) {
+		Block& block = blocks[i / BLOCK];
+		const size_t l = i % BLOCK;
+		reflect(block.x[l], block.vx[l], size_enclosure);
+		reflect(block.y[l], block.vy[l], size_enclosure);
+		reflect(block.z[l], block.vz[l], size_enclosure);
+	}
+
+	// j merges into i (j deleted)
+	inline void merge_objects(size_t i, size_t j) {
+		// Merge attributes
+		mass(i) += mass(j);
+		vx(i) += vx(j);
+		vy(i) += vy(j);
+		vz(i) += vz(j);
+
+		// Delete second object: move all objects after it one place down, over the block boundaries
+		for (size_t k = j; k + 1 < size; k++) {
+			mass(k) = mass(k + 1);
+			x(k) = x(k + 1);
+			y(k) = y(k + 1);
+			z(k) = z(k + 1);
+			vx(k) = vx(k + 1);
+			vy(k) = vy(k + 1);
+			vz(k) = vz(k + 1);
+			fx(k) = fx(k + 1);
+			fy(k) = fy(k + 1);
+			fz(k) = fz(k + 1);
+		}
+
+		size--;
+		if (size % BLOCK == 0) {
+			blocks.pop_back();
+		}
+	}
+
+	// Check for possible collisions (for objects j < i), removed(j) is called before object j merges into i
+	template <typename Removed>
+	inline void check_collisions(size_t& i, Removed removed) {
+		size_t iterator = 0;
+		while (iterator < i)
+		{
+			// Merge when distance is less than 1
+			if (dst_sqr(this, i, iterator) < 1)
+			{
+				// Collision detected, merge iterator object into i
+				removed(iterator);
+				merge_objects(i, iterator);
+
+				// Decrement i, as i is now one index lower
+				i--;
+#ifndef NDEBUG
+				std::printf("Two bodies collided. New size: %.2E\n", mass(i));
+#endif
+			}
+			else
+			{
+				iterator++;
+			}
+		}
+	}
+
+};
+
+inline double dst_sqr(Object* n, size_t i1, size_t i2) {
+	return sqr(n->x(i1) - n->x(i2)) + sqr(n->y(i1) - n->y(i2)) + sqr(n->z(i1) - n->z(i2));
+}
+
+inline double dst_cube(Object* n, size_t i1, size_t i2) {
+	double dst = std::sqrt(dst_sqr(n,i1,i2));
+	return cube(dst);
+}
@@ -0,0 +1,289 @@
+#include "sim-aosoa.h"
+
+bool en_benchmark = false;
+
+// Positions written every traj_every steps (only with traj=file)
+TrajectoryWriter trajectory;
+
+// Conserved quantities and speed every telemetry_every steps (only with telemetry=file)
+Telemetry telemetry;
+
+// Heap allocations of the time loop (only counted with TRACK_ALLOCS), and of all steps after the first one
+allocWatch loopAllocs, steadyAllocs;
+
+int main(int argc, char** argv) {
+    auto t1 = std::chrono::high_resolution_clock::now();  // Start measuring the execution time
+
+    // Check the input parameters
+    const char* arguments[5] = {"num_objects", "num_iterations",
+                                "random_seed", "size_enclosure", "time_step"};
+
+    // Optional arguments (en_benchmark, init=file, en_philox, en_exact_config, traj=file, traj_every=K, traj_bits=B, traj_keyframe=F, telemetry=file, telemetry_every=K, en_alloc_check) follow the five positional ones
+    Options options(argc, argv, 6);
+    en_benchmark = options.has("en_benchmark");
+    if (!en_benchmark) {
+        std::cout << "sim-aosoa invoked with " << argc - 1 << " parameters."
+                  << "\n"
+                  << "Arguments:\n";
+    }
+
+    // Iterate for every argument needed
+    if (!en_benchmark) {
+        for (int i = 1; i < 6; i++) {
+            // Only assign variables that exist, variables that don't exist get an ?
+            if (argc > i) {
+                std::cout << " " << arguments[i - 1] << ": " << argv[i] << "\n";
+            } else {
+                std::cout << " " << arguments[i - 1] << ": ?"
+                          << "\n";
+            }
+        }
+    }
+
+    // Check the parameter count
+    if (argc < 6) {
+        std::cerr << "Error: Wrong number of parameters\n";
+        return -1;
+    }
+    std::string unknownOption = options.unknown({"en_benchmark", "init", "en_philox", "en_exact_config", "traj", "traj_every", "traj_bits", "traj_keyframe", "telemetry", "telemetry_every", "en_alloc_check"});
+    if (!unknownOption.empty()) {
+        std::cerr << "Error: Unknown option " << unknownOption << "\n";
+        return -1;
+    }
+#ifndef TRACK_ALLOCS
+    if (options.has("en_alloc_check")) {
+        std::cerr << "Error: en_alloc_check needs a build with TRACK_ALLOCS\n";
+        return -1;
+    }
+#endif
+
+    const int num_objects = std::stoi(argv[1]);
+    const int num_iterations = std::stoi(argv[2]);
+    const uint64_t seed = std::stoull(argv[3]);
+    const double size_enclosure = std::stod(argv[4]);
+    const double time_step = std::stod(argv[5]);
+    const size_t trajEvery = std::stoull(options.get("traj_every", "1"));
+    const int trajBits = std::stoi(options.get("traj_bits", "20"));
+    const size_t telemetryEvery = std::stoull(options.get("telemetry_every", "1"));
+
+    if (num_objects < 0) {
+        std::cerr << "Error: Invalid number of objects\n";
+        return -2;
+    }
+    if (num_iterations < 0) {
+        std::cerr << "Error: Invalid number of iterations\n";
+        return -2;
+    }
+
+    // Seed is already an unsigned 64 bit integer, no need to check for validity
+
+    if (size_enclosure < 0) {
+        std::cerr << "Error: Invalid box size\n";
+        return -2;
+    }
+    if (time_step < 0) {
+        std::cerr << "Error: Invalid time increment\n";
+        return -2;
+    }
+    if (trajEvery == 0) {
+        std::cerr << "Error: Invalid trajectory interval\n";
+        return -2;
+    }
+    if (trajBits < 1 || trajBits > 32) {
+        std::cerr << "Error: Invalid trajectory precision\n";
+        return -2;
+    }
+    if (telemetryEvery == 0) {
+        std::cerr << "Error: Invalid telemetry interval\n";
+        return -2;
+    }
+
+    // Read the objects from the init file, or generate Object; assign random values to mass and position
+    Config config;
+    if (options.has("init")) {
+        std::string error = loadConfig(options.get("init"), config);
+        if (!error.empty()) {
+            std::cerr << "Error: " << error << "\n";
+            return -3;
+        }
+    }
+    Object object = options.has("init") ? Object(config) : Object((size_t)num_objects, seed, size_enclosure, options.has("en_philox"));
+    config = Config();
+
+    // Merged objects leave the trajectory
+    auto removed = [&](size_t j) {
+        trajectory.remove(j);
+    };
+
+    // Check for collisions before starting
+    for (size_t i = 0; i < object.size; i++) {
+        object.check_collisions(i, removed);
+    }
+
+    // Values of object i as printed in the config files
+    auto getConfigValues = [&](size_t i, double* values) {
+        values[0] = object.x(i);
+        values[1] = object.y(i);
+        values[2] = object.z(i);
+        values[3] = object.vx(i);
+        values[4] = object.vy(i);
+        values[5] = object.vz(i);
+        values[6] = object.mass(i);
+    };
+
+    // Print the initial config
+    if (!writeConfig("init_config.txt", size_enclosure, time_step, object.size, getConfigValues, options.has("en_exact_config"))) {
+        std::cerr << "Error: Can't write init_config.txt\n";
+        return -3;
+    }
+
+    // Start the trajectory with the initial positions, a frame is added after every trajEvery steps
+    auto getPosition = [&](size_t i, double* p) {
+        p[0] = object.x(i);
+        p[1] = object.y(i);
+        p[2] = object.z(i);
+    };
+    if (options.has("traj")) {
+        if (!trajectory.open(options.get("traj"), size_enclosure, time_step, trajBits, std::stoul(options.get("traj_keyframe", "100")),
+                             object.size, num_iterations / trajEvery + 1)) {
+            std::cerr << "Error: Can't write " << options.get("traj") << "\n";
+            return -3;
+        }
+        trajectory.frame(0, object.size, getPosition);
+    }
+
+    // Conserved quantities and speed of the time loop
+    auto getVelocity = [&](size_t i, double& mass, double* v) {
+        mass = object.mass(i);
+        v[0] = object.vx(i);
+        v[1] = object.vy(i);
+        v[2] = object.vz(i);
+    };
+    if (options.has("telemetry") && !telemetry.open(options.get("telemetry"), telemetryEvery)) {
+        std::cerr << "Error: Can't write " << options.get("telemetry") << "\n";
+        return -3;
+    }
+
+    // Time loop
+    loopAllocs.start();
+    for (size_t iteration = 0; iteration < (unsigned)num_iterations; iteration++) {
+        if (iteration == 1) {
+            steadyAllocs.start();
+        }
+        telemetry.startStep(object.size);
+        // Reset all forces to zero
+        object.reset_forces();
+
+        // Calculate the force, change in velocity and position
+        for (size_t i = 0; i < object.size; i++) {
+            // Object i stays in registers, the objects j are visited block by block
+            const double xi = object.x(i);
+            const double yi = object.y(i);
+            const double zi = object.z(i);
+            const double mi = object.mass(i);
+            double fxi = object.fx(i);
+            double fyi = object.fy(i);
+            double fzi = object.fz(i);
+            for (size_t jb = (i + 1) / BLOCK, first = (i + 1) % BLOCK; jb * BLOCK < object.size; jb++, first = 0) {
+                Block& block = object.blocks[jb];
+                const size_t lanes = std::min((size_t)BLOCK, object.size - jb * BLOCK);
+                for (size_t l = first; l < lanes; l++) {
+                    double dst = std::sqrt(sqr(xi - block.x[l]) + sqr(yi - block.y[l]) + sqr(zi - block.z[l]));
+                    double dstCube = cube(dst);
+                    double massGravDist = mi * block.mass[l] * G / dstCube;
+                    double fx = massGravDist * (block.x[l] - xi);
+                    double fy = massGravDist * (block.y[l] - yi);
+                    double fz = massGravDist * (block.z[l] - zi);
+
+                    fxi += fx;
+                    block.fx[l] -= fx;
+                    fyi += fy;
+                    block.fy[l] -= fy;
+                    fzi += fz;
+                    block.fz[l] -= fz;
+                }
+            }
+            object.fx(i) = fxi;
+            object.fy(i) = fyi;
+            object.fz(i) = fzi;
+
+            // All forces on objects[i] are now computed, calculate the velocity change
+            // F=ma -> a=F/m
+            // dv=a*dt -> dv=F/m*dt
+
+            object.vx(i) += object.fx(i) / object.mass(i) * time_step;
+            object.vy(i) += object.fy(i) / object.mass(i) * time_step;
+            object.vz(i) += object.fz(i) / object.mass(i) * time_step;
+
+            // Update the position of the object
+
+            object.x(i) += object.vx(i) * time_step;
+            object.y(i) += object.vy(i) * time_step;
+            object.z(i) += object.vz(i) * time_step;
+
+            // If objects are outside of boundary, set them to the perimeter
+
+            object.adjust_for_boundary(size_enclosure, i);
+
+            // Check for collisions (for all objects j < i)
+
+            object.check_collisions(i, removed);
+        }
+
+        // Printing (only in debug)
+#ifndef NDEBUG
+        std::printf("it %d\t  x\t\t  y\t\t  z\n", (int)iteration);
+        unsigned int j = 0;
+        for (size_t i = 0; i < object.size; i++) {
+            std::printf("%04d: f: %.2E \t%.2E \t%.2E\n", j, object.fx(i), object.fy(i), object.fz(i));
+            std::printf("%04d: p: %.2E \t%.2E \t%.2E\n", j, object.x(i), object.y(i), object.z(i));
+            std::printf("%04d: v: %.2E \t%.2E \t%.2E\n\n", j, object.vx(i), object.vy(i), object.vz(i));
+            j++;
+        }
+        if (object.size > 1) {
+            std::printf("Distance (0-1) %.2E\n", std::sqrt(dst_sqr(&object, 0, 1)));
+        }
+#endif
+
+        telemetry.endStep(iteration + 1, object.size, getVelocity);
+        if (trajectory.isOpen() && (iteration + 1) % trajEvery == 0) {
+            trajectory.frame(iteration + 1, object.size, getPosition);
+        }
+
+    }  // End time loop
+
+    loopAllocs.stop();
+
+    // The steps after the first one must not allocate
+    if (num_iterations > 1) {
+        steadyAllocs.stop();
+    }
+    if (options.has("en_alloc_check") && steadyAllocs.getCount() > 0) {
+        std::cerr << "Error: " << steadyAllocs.getCount() << " heap allocations after the first step\n";
+        return -4;
+    }
+
+    // Printing final config
+    if (!writeConfig("final_config.txt", size_enclosure, time_step, object.size, getConfigValues, options.has("en_exact_config"))) {
+        std::cerr << "Error: Can't write final_config.txt\n";
+        return -3;
+    }
+    if (!trajectory.close()) {
+        std::cerr << "Error: Can't write " << options.get("traj") << "\n";
+        return -3;
+    }
+
+    // Measure execution time and print it
+    auto t2 = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> exec_ms = t2 - t1;
+    if (en_benchmark) {
+        std::printf("%f", exec_ms.count());
+    } else {
+        std::printf("Total execution time was %f ms.\n", exec_ms.count());
+        const char* allocNames[2] = { "Time loop", "after the first step" };
+        const allocWatch allocs[2] = { loopAllocs, steadyAllocs };
+        printAllocations(allocNames, allocs, 2);
+    }
+
+    return 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <string> //needed for conversing argv
+#include "object.h"
+#include "../common/allocs.h"
+#include "../common/config_io.h"
+#include "../common/options.h"
+#include "../common/telemetry.h"
+#include "../common/trajectory.h"
+
+#define G 6.674E-11
+
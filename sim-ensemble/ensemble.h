@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "../common/integrate.h"
+#include "../common/philox.h"
+
+// L independent simulations side by side: slot i of lane l is object i of simulation l, and the attributes
+// are stored as [slot][lane], so the loops over the lanes of a slot run on SIMD registers. alive[i * L + l] is
+// 1 for the live objects of a lane and 0 for its dead slots (merged in this step, or past the end of a lane
+// with fewer objects). Dead slots take part in the force loop, but their forces are multiplied by 0, so the
+// loop has no branches. Every lane does the same steps in the same order as sim-soa, so its objects are
+// identical to a sim-soa run of that simulation
+template <size_t L>
+struct Ensemble {
+    // Largest number of objects of the lanes, the slots [size[l], slots) of lane l are dead
+    size_t slots = 0;
+    size_t size[L] = {};
+
+    std::vector<double> mass;
+
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> z;
+
+    std::vector<double> vx;
+    std::vector<double> vy;
+    std::vector<double> vz;
+
+    std::vector<double> fx;
+    std::vector<double> fy;
+    std::vector<double> fz;
+
+    std::vector<double> alive;
+
+    // Room for n objects per lane, all lanes empty until generate
+    Ensemble(const size_t n) : slots(n),
+        mass(n * L, 1), x(n * L), y(n * L), z(n * L), vx(n * L), vy(n * L), vz(n * L), fx(n * L), fy(n * L), fz(n * L), alive(n * L, 0.0) {
+    }
+
+    // Empty all lanes for the next simulations
+    void reset() {
+        slots = alive.size() / L;
+        std::fill(std::begin(size), std::end(size), 0);
+        std::fill(alive.begin(), alive.end(), 0.0);
+        std::fill(vx.begin(), vx.end(), 0.0);
+        std::fill(vy.begin(), vy.end(), 0.0);
+        std::fill(vz.begin(), vz.end(), 0.0);
+    }
+
+    // The objects of lane l generated like sim-soa does for this seed (at rest)
+    void generate(const size_t l, const uint64_t seed, const double size_enclosure, const bool en_philox) {
+        size[l] = slots;
+        for (size_t i = 0; i < slots; i++) {
+            alive[i * L + l] = 1.0;
+        }
+        if (en_philox) {
+            Philox rng(seed);
+            for (size_t i = 0; i < slots; i++) {
+                philoxObject(rng, i, size_enclosure, x[i * L + l], y[i * L + l], z[i * L + l], mass[i * L + l]);
+            }
+            return;
+        }
+        std::mt19937_64 gen(seed);
+        std::uniform_real_distribution<> uniform_distr(0, size_enclosure);
+        std::normal_distribution<double> normal_distr(1E21, 1E15);
+        for (size_t i = 0; i < slots; i++) {
+            x[i * L + l] = uniform_distr(gen);
+            y[i * L + l] = uniform_distr(gen);
+            z[i * L + l] = uniform_distr(gen);
+            mass[i * L + l] = normal_distr(gen);
+        }
+    }
+
+    // Merge the live objects j < i that are closer than 1 into i, in the order of sim-soa (j ascending). The
+    // position of i doesn't change with a merge, so the distances are computed for all lanes at once
+    void mergeRow(const size_t i) {
+        const size_t row = i * L;
+        for (size_t j = 0; j < i; j++) {
+            const size_t col = j * L;
+            bool hits[L];
+            bool any = false;
+            for (size_t l = 0; l < L; l++) {
+                const double dx = x[row + l] - x[col + l];
+                const double dy = y[row + l] - y[col + l];
+                const double dz = z[row + l] - z[col + l];
+                hits[l] = alive[row + l] * alive[col + l] != 0 && dx * dx + dy * dy + dz * dz < 1;
+                any |= hits[l];
+            }
+            if (!any) {
+                continue;
+            }
+            for (size_t l = 0; l < L; l++) {
+                if (hits[l]) {
+                    mass[row + l] += mass[col + l];
+                    vx[row + l] += vx[col + l];
+                    vy[row + l] += vy[col + l];
+                    vz[row + l] += vz[col + l];
+                    alive[col + l] = 0.0;
+                }
+            }
+        }
+    }
+
+    // Move the live objects of every lane to the front, in their order, so the dead slots are at the end
+    void compact() {
+        size_t largest = 0;
+        for (size_t l = 0; l < L; l++) {
+            size_t n = 0;
+            for (size_t i = 0; i < slots; i++) {
+                if (alive[i * L + l] != 0) {
+                    const size_t from = i * L + l;
+                    const size_t to = n * L + l;
+                    mass[to] = mass[from];
+                    x[to] = x[from];
+                    y[to] = y[from];
+                    z[to] = z[from];
+                    vx[to] = vx[from];
+                    vy[to] = vy[from];
+                    vz[to] = vz[from];
+                    alive[to] = 1.0;
+                    n++;
+                }
+            }
+            for (size_t i = n; i < slots; i++) {
+                alive[i * L + l] = 0.0;
+            }
+            size[l] = n;
+            largest = std::max(largest, n);
+        }
+        slots = largest;
+    }
+
+    // The collision check before the first step
+    void mergeInitial() {
+        for (size_t i = 0; i < slots; i++) {
+            mergeRow(i);
+        }
+        compact();
+    }
+
+    // One time step of all lanes: forces, velocity and position of every slot, then its collisions with the
+    // slots before it
+    void step(const double time_step, const double size_enclosure, const double gravity) {
+        std::fill(fx.begin(), fx.begin() + slots * L, 0.0);
+        std::fill(fy.begin(), fy.begin() + slots * L, 0.0);
+        std::fill(fz.begin(), fz.begin() + slots * L, 0.0);
+        for (size_t i = 0; i < slots; i++) {
+            const size_t row = i * L;
+            double xi[L], yi[L], zi[L], mi[L], fxi[L], fyi[L], fzi[L], live[L];
+            for (size_t l = 0; l < L; l++) {
+                xi[l] = x[row + l];
+                yi[l] = y[row + l];
+                zi[l] = z[row + l];
+                mi[l] = mass[row + l];
+                fxi[l] = fx[row + l];
+                fyi[l] = fy[row + l];
+                fzi[l] = fz[row + l];
+                live[l] = alive[row + l];
+            }
+            for (size_t j = i + 1; j < slots; j++) {
+                const size_t col = j * L;
+#ifdef _OPENMP
+                #pragma omp simd
+#endif
+                for (size_t l = 0; l < L; l++) {
+                    // A pair with a dead object gets the distance 1, so its force is finite, and adds force * 0. The
+                    // sums start at +0, so adding a zero force leaves them bit for bit the same
+                    const double pair = live[l] * alive[col + l];
+                    const double dstSqr = (xi[l] - x[col + l]) * (xi[l] - x[col + l]) + (yi[l] - y[col + l]) * (yi[l] - y[col + l]) +
+                                          (zi[l] - z[col + l]) * (zi[l] - z[col + l]);
+                    const double dst = std::sqrt(dstSqr * pair + (1 - pair));
+                    const double massGravDist = mi[l] * mass[col + l] * gravity / (dst * dst * dst) * pair;
+                    const double forceX = massGravDist * (x[col + l] - xi[l]);
+                    const double forceY = massGravDist * (y[col + l] - yi[l]);
+                    const double forceZ = massGravDist * (z[col + l] - zi[l]);
+                    fxi[l] += forceX;
+                    fx[col + l] -= forceX;
+                    fyi[l] += forceY;
+                    fy[col + l] -= forceY;
+                    fzi[l] += forceZ;
+                    fz[col + l] -= forceZ;
+                }
+            }
+
+            // All forces on slot i are known: velocity, position and boundary bounce (dead slots are never read)
+            for (size_t l = 0; l < L; l++) {
+                vx[row + l] += fxi[l] / mi[l] * time_step;
+                vy[row + l] += fyi[l] / mi[l] * time_step;
+                vz[row + l] += fzi[l] / mi[l] * time_step;
+                x[row + l] += vx[row + l] * time_step;
+                y[row + l] += vy[row + l] * time_step;
+                z[row + l] += vz[row + l] * time_step;
+                reflect(x[row + l], vx[row + l], size_enclosure);
+                reflect(y[row + l], vy[row + l], size_enclosure);
+                reflect(z[row + l], vz[row + l], size_enclosure);
+            }
+
+            mergeRow(i);
+        }
+        compact();
+    }
+};
+
+// Calls run(ensemble) with an Ensemble of n objects and 1, 2, 4 or 8 lanes
+template <typename Run>
+void withEnsemble(const size_t lanes, const size_t n, Run run) {
+    if (lanes == 1) {
+        Ensemble<1> ensemble(n);
+        run(ensemble);
+    } else if (lanes == 2) {
+        Ensemble<2> ensemble(n);
+        run(ensemble);
+    } else if (lanes == 4) {
+        Ensemble<4> ensemble(n);
+        run(ensemble);
+    } else {
+        Ensemble<8> ensemble(n);
+        run(ensemble);
+    }
+}
@@ -0,0 +1,174 @@
+#include "sim-ensemble.h"
+
+bool en_benchmark = false;
+
+// Heap allocations of the time loops (only counted with TRACK_ALLOCS), and of all steps after the first one
+allocWatch loopAllocs, steadyAllocs;
+
+int main(int argc, char** argv) {
+    auto t1 = std::chrono::high_resolution_clock::now();  // Start measuring the execution time
+
+    // Check the input parameters
+    const char* arguments[5] = {"num_objects", "num_iterations",
+                                "random_seed", "size_enclosure", "time_step"};
+
+    // Optional arguments (en_benchmark, en_philox, en_exact_config, ensemble=W, lanes=L, en_alloc_check) follow the five positional ones
+    Options options(argc, argv, 6);
+    en_benchmark = options.has("en_benchmark");
+    if (!en_benchmark) {
+        std::cout << "sim-ensemble invoked with " << argc - 1 << " parameters."
+                  << "\n"
+                  << "Arguments:\n";
+    }
+
+    // Iterate for every argument needed
+    if (!en_benchmark) {
+        for (int i = 1; i < 6; i++) {
+            // Only assign variables that exist, variables that don't exist get an ?
+            if (argc > i) {
+                std::cout << " " << arguments[i - 1] << ": " << argv[i] << "\n";
+            } else {
+                std::cout << " " << arguments[i - 1] << ": ?"
+                          << "\n";
+            }
+        }
+    }
+
+    // Check the parameter count
+    if (argc < 6) {
+        std::cerr << "Error: Wrong number of parameters\n";
+        return -1;
+    }
+    std::string unknownOption = options.unknown({"en_benchmark", "en_philox", "en_exact_config", "ensemble", "lanes", "en_alloc_check"});
+    if (!unknownOption.empty()) {
+        std::cerr << "Error: Unknown option " << unknownOption << "\n";
+        return -1;
+    }
+#ifndef TRACK_ALLOCS
+    if (options.has("en_alloc_check")) {
+        std::cerr << "Error: en_alloc_check needs a build with TRACK_ALLOCS\n";
+        return -1;
+    }
+#endif
+
+    const int num_objects = std::stoi(argv[1]);
+    const int num_iterations = std::stoi(argv[2]);
+    const uint64_t seed = std::stoull(argv[3]);
+    const double size_enclosure = std::stod(argv[4]);
+    const double time_step = std::stod(argv[5]);
+    const int simulations = std::stoi(options.get("ensemble", "8"));
+    const int lanes = std::stoi(options.get("lanes", "4"));
+
+    if (num_objects < 0) {
+        std::cerr << "Error: Invalid number of objects\n";
+        return -2;
+    }
+    if (num_iterations < 0) {
+        std::cerr << "Error: Invalid number of iterations\n";
+        return -2;
+    }
+
+    // Seed is already an unsigned 64 bit integer, no need to check for validity
+
+    if (size_enclosure < 0) {
+        std::cerr << "Error: Invalid box size\n";
+        return -2;
+    }
+    if (time_step < 0) {
+        std::cerr << "Error: Invalid time increment\n";
+        return -2;
+    }
+    if (simulations < 1) {
+        std::cerr << "Error: Invalid number of simulations\n";
+        return -2;
+    }
+    if (lanes != 1 && lanes != 2 && lanes != 4 && lanes != 8) {
+        std::cerr << "Error: Invalid number of lanes\n";
+        return -2;
+    }
+    if (!en_benchmark) {
+        std::cout << "Ensemble of " << simulations << " simulations, " << lanes << " lanes\n";
+    }
+
+    // Simulation k uses the seed random_seed + k and writes init_config_k.txt and final_config_k.txt. The
+    // simulations run lanes at a time, the lanes of the last group without a simulation stay empty
+    int failed = 0;
+    withEnsemble((size_t)lanes, (size_t)num_objects, [&](auto& ensemble) {
+        const size_t width = sizeof(ensemble.size) / sizeof(ensemble.size[0]);
+        for (size_t first = 0; first < (size_t)simulations && failed == 0; first += width) {
+            const size_t active = std::min(width, (size_t)simulations - first);
+            ensemble.reset();
+            for (size_t l = 0; l < active; l++) {
+                ensemble.generate(l, seed + first + l, size_enclosure, options.has("en_philox"));
+            }
+
+            // Check for collisions before starting
+            ensemble.mergeInitial();
+
+            // Values of object i of lane l as printed in the config files
+            auto writeLane = [&](const char* name, size_t l) {
+                const std::string path = std::string(name) + "_" + std::to_string(first + l) + ".txt";
+                auto getConfigValues = [&](size_t i, double* values) {
+                    const size_t k = i * width + l;
+                    values[0] = ensemble.x[k];
+                    values[1] = ensemble.y[k];
+                    values[2] = ensemble.z[k];
+                    values[3] = ensemble.vx[k];
+                    values[4] = ensemble.vy[k];
+                    values[5] = ensemble.vz[k];
+                    values[6] = ensemble.mass[k];
+                };
+                if (!writeConfig(path, size_enclosure, time_step, ensemble.size[l], getConfigValues, options.has("en_exact_config"))) {
+                    std::cerr << "Error: Can't write " << path << "\n";
+                    failed = -3;
+                }
+            };
+
+            // Print the initial configs
+            for (size_t l = 0; l < active; l++) {
+                writeLane("init_config", l);
+            }
+
+            // Time loop
+            loopAllocs.start();
+            for (size_t iteration = 0; iteration < (unsigned)num_iterations; iteration++) {
+                if (iteration == 1) {
+                    steadyAllocs.start();
+                }
+                ensemble.step(time_step, size_enclosure, G);
+            }
+            loopAllocs.stop();
+
+            // The steps after the first one must not allocate
+            if (num_iterations > 1) {
+                steadyAllocs.stop();
+            }
+
+            // Printing final configs
+            for (size_t l = 0; l < active; l++) {
+                writeLane("final_config", l);
+            }
+        }
+    });
+    if (failed != 0) {
+        return failed;
+    }
+    if (options.has("en_alloc_check") && steadyAllocs.getCount() > 0) {
+        std::cerr << "Error: " << steadyAllocs.getCount() << " heap allocations after the first step\n";
+        return -4;
+    }
+
+    // Measure execution time and print it
+    auto t2 = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> exec_ms = t2 - t1;
+    if (en_benchmark) {
+        std::printf("%f", exec_ms.count());
+    } else {
+        std::printf("Total execution time was %f ms.\n", exec_ms.count());
+        const char* allocNames[2] = { "Time loops", "after the first step" };
+        const allocWatch allocs[2] = { loopAllocs, steadyAllocs };
+        printAllocations(allocNames, allocs, 2);
+    }
+
+    return 0;
+}
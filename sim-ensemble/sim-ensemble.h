@@ -0,0 +1,12 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <string> //needed for conversing argv
+#include "ensemble.h"
+#include "../common/allocs.h"
+#include "../common/config_io.h"
+#include "../common/options.h"
+
+#define G 6.674E-11
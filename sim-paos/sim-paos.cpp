@@ -17,46 +17,122 @@ uint64_t seed;
 double size_enclosure;
 double time_step;
 bool en_benchmark = false;
+bool en_sap = false;
+bool en_persistent = false;
+bool en_swept = false;
+bool en_deterministic = false;
+bool en_adaptive = false;
+size_t deterministicChunks = 64;  // Fixed chunks of the force rows with en_deterministic
+size_t trajEvery = 1;  // Steps between two trajectory frames
 
 // OBJECTS VECTOR
-std::vector<Object> objects;
+numa_vector<Object> objects;
 
 // FUNCTIONS
 
 // Watch class used for easy benchmarking
 watch collisionWatch, updateObjWatch, totalWatch;
 
+// Heap allocations of the phases (only counted with TRACK_ALLOCS), and of all steps after the first one
+allocWatch collisionAllocs, updateObjAllocs, steadyAllocs;
+
+// Per thread time spent in the force and collision pair loops, and waiting in the barriers of en_persistent
+std::vector<watch> forceThreadWatch, collisionThreadWatch, syncThreadWatch;
+
+// Per thread force buffers (x, y and z of every object), per chunk with en_deterministic
+std::vector<std::vector<double>> forceBuffers;
+
+// Team size of the update and collision phases (only used with en_adaptive)
+AdaptiveThreads updateObjTeam, collisionTeam;
+
+// Broad phase for the collision check (only used with en_sap)
+SweepAndPrune sweep;
+
+// Positions at the start of the step (x, y and z of every object, only used with en_swept), the check
+// before the first step only uses the current positions
+std::vector<double> previousPositions;
+bool sweptReady = false;
+
+// Positions written every trajEvery steps (only with traj=file)
+TrajectoryWriter trajectory;
+
+// Conserved quantities and speed (only with telemetry=file)
+Telemetry telemetry;
+
+// Radial profile, mass spectrum and largest bodies every analysis_every steps (only with analysis=prefix)
+InSituAnalysis analysis;
+
 // Compare the pairs as if they were executed in sequential order (i first then j)
 inline bool operator<(const Pair& p1, const Pair& p2) {
     return (p1.j - p1.i * num_objects) < (p2.j - p2.i * num_objects);
 }
 
-// Checks for collisions between object i and objects 0 to i - 1
-void checkCollisions() {
-    collisionWatch.start();
+// Collisions found in the current step, sorted in sequential order before they are merged. A vector
+// instead of a set, so the collision check doesn't allocate once the capacity has grown
+std::vector<Pair> toRemove;
+
+// True if objects i and j are closer than 1 at the end of the step, or with en_swept at any moment of the step
+inline bool collides(size_t i, size_t j) {
+    if (dst_sqr(objects[i], objects[j]) < 1) {
+        return true;
+    }
+    if (!sweptReady) {
+        return false;
+    }
+    const double* pi = &previousPositions[3 * i];
+    const double* pj = &previousPositions[3 * j];
+    return sweptCollision(pi[0] - pj[0], pi[1] - pj[1], pi[2] - pj[2],
+                          (objects[i].p[0] - pi[0]) - (objects[j].p[0] - pj[0]),
+                          (objects[i].p[1] - pi[1]) - (objects[j].p[1] - pj[1]),
+                          (objects[i].p[2] - pi[2]) - (objects[j].p[2] - pj[2]), 1);
+}
 
-    std::set<Pair> toRemove;
+// Finds the collisions between object i and objects 0 to i - 1 (run by every thread of the team)
+void findCollisions() {
     int objectsSize = (int) objects.size();
 
-#pragma omp parallel for schedule(guided)
-    for (int i = 0; i < objectsSize; i++) {
-        for (int j = i - 1; j >= 0; j--) {
-            if (dst_sqr(objects[i], objects[j]) < 1) {
+    if (en_sap) {
+        // Only check the pairs that overlap along the x axis (with en_swept over the whole path of the step)
+#pragma omp single
+        sweep.update(objectsSize,
+            [&](size_t i) { return sweptReady ? std::min(previousPositions[3 * i], objects[i].p[0]) : objects[i].p[0]; },
+            [&](size_t i) { return (sweptReady ? std::max(previousPositions[3 * i], objects[i].p[0]) : objects[i].p[0]) + 1; });
+        sweep.findPairs([&](size_t i, size_t j) {
+            if (collides(i, j)) {
+#pragma omp critical
+                toRemove.emplace_back(i, j);
+            }
+        });
+    } else {
+        // Every thread gets a block of rows with the same number of pairs
+        const int tid = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
+        const int rowBegin = (int)lowerTriangleRow(objectsSize, tid, threads);
+        const int rowEnd = (int)lowerTriangleRow(objectsSize, tid + 1, threads);
+
+        collisionThreadWatch[tid].start();
+        for (int i = rowBegin; i < rowEnd; i++) {
+            for (int j = i - 1; j >= 0; j--) {
+                if (collides(i, j)) {
 #pragma omp critical
-                toRemove.emplace(i, j);
+                    toRemove.emplace_back(i, j);
+                }
             }
         }
+        collisionThreadWatch[tid].stop();
     }
+}
 
-    // All collisions have been detected, now merge the collided objects
+// Merges the collided objects and removes the merged ones (run by a single thread)
+void mergeCollisions() {
     //std::printf("New collision check\n");
+    std::sort(toRemove.begin(), toRemove.end());
     bool needRemoval = !toRemove.empty();
     while (!toRemove.empty()) {
-        // Remove the last element from the set
-        auto it = std::prev(toRemove.end());
-        auto i = (*it).i;
-        auto j = (*it).j;
-        toRemove.erase(it);
+        // Remove the last element
+        auto i = toRemove.back().i;
+        auto j = toRemove.back().j;
+        toRemove.pop_back();
 
         if (objects[j].removeFlag) {
             continue;
@@ -73,6 +149,10 @@ void checkCollisions() {
 
     // Remove elements if necessary
     if (needRemoval) {
+        if (en_sap) {
+            sweep.remove([&](size_t i) { return objects[i].removeFlag; });
+        }
+        trajectory.removeFlagged(objects.size(), [&](size_t i) { return objects[i].removeFlag; });
         objects.erase(
             std::remove_if(
                 objects.begin(),
@@ -82,46 +162,199 @@ void checkCollisions() {
                 }),
             objects.end());
     }
+}
+
+// Checks for collisions between object i and objects 0 to i - 1
+void checkCollisions() {
+    collisionWatch.start();
+    collisionAllocs.start();
+
+    // With en_adaptive the team follows the pairs left (the objects with en_sap)
+    const double objectsSize = (double)objects.size();
+    const int team = en_adaptive ? collisionTeam.begin(en_sap ? objectsSize : objectsSize * (objectsSize - 1) / 2) : omp_get_max_threads();
+#pragma omp parallel num_threads(team)
+    findCollisions();
+    if (en_adaptive) {
+        collisionTeam.end();
+    }
+
+    // All collisions have been detected, now merge the collided objects
+    mergeCollisions();
+
     collisionWatch.stop();
+
+    collisionAllocs.stop();
 }
 
-void updateObjects() {
-    updateObjWatch.start();
+// Add the forces of the pairs of the rows [rowBegin, rowEnd) to buffer (the pairs of a row also change the
+// force on the objects j > i)
+void addPairForces(size_t rowBegin, size_t rowEnd, double* buffer) {
     auto objectsSize = objects.size();
-    //std::printf("Updating dim %i, objects size %zi\n", dim, objectsSize);
-    for (size_t i = 0; i < objectsSize; ++i) {
+    for (size_t i = rowBegin; i < rowEnd; ++i) {
         for (size_t j = i + 1; j < objectsSize; j++) {
             double mgd = objects[i].mass * objects[j].mass * G / dst_cube(objects[i], objects[j]);
             for (size_t dim = 0; dim < 3; dim++) {
                 double f = mgd * (objects[j].p[dim] - objects[i].p[dim]);
-                objects[i].f[dim] += f;
-                objects[j].f[dim] -= f;
+                buffer[3 * i + dim] += f;
+                buffer[3 * j + dim] -= f;
             }
         }
-        // For all dimensions
+    }
+}
+
+// Calculate the force between all pairs of objects (run by every thread of the team)
+void computeForces() {
+    auto objectsSize = objects.size();
+    const int tid = omp_get_thread_num();
+    const int threads = omp_get_num_threads();
+
+    forceThreadWatch[tid].start();
+    if (en_deterministic) {
+        // A fixed number of chunks with the same number of pairs, each with its own buffer, whichever thread
+        // computes it. The buffers are summed in chunk order, so the forces don't depend on the threads
+#pragma omp for schedule(dynamic) nowait
+        for (int c = 0; c < (int)deterministicChunks; c++) {
+            addPairForces(upperTriangleRow(objectsSize, c, deterministicChunks), upperTriangleRow(objectsSize, c + 1, deterministicChunks), forceBuffers[c].data());
+        }
+    } else {
+        // Every thread gets a block of rows with the same number of pairs, and adds the forces to its own buffer
+        addPairForces(upperTriangleRow(objectsSize, tid, threads), upperTriangleRow(objectsSize, tid + 1, threads), forceBuffers[tid].data());
+    }
+    forceThreadWatch[tid].stop();
+}
+
+// Calculate the change in velocity and position of every object (run by every thread of the team,
+// after all forces are computed)
+void moveObjects() {
+    auto objectsSize = objects.size();
+    const int tid = omp_get_thread_num();
+    const int threads = omp_get_num_threads();
+    const size_t begin = evenRow(objectsSize, tid, threads);
+    const size_t end = evenRow(objectsSize, tid + 1, threads);
+    const int buffers = en_deterministic ? (int)deterministicChunks : threads;
+
+    // Sum the buffers of all threads or chunks in order (and clear them for the next step)
+    for (size_t i = begin; i < end; i++) {
         for (size_t dim = 0; dim < 3; dim++) {
-            // Calculate velocity
-            objects[i].v[dim] += objects[i].f[dim] / objects[i].mass * time_step;
+            for (int t = 0; t < buffers; t++) {
+                objects[i].f[dim] += forceBuffers[t][3 * i + dim];
+                forceBuffers[t][3 * i + dim] = 0;
+            }
+            if (en_swept) {
+                previousPositions[3 * i + dim] = objects[i].p[dim];
+            }
+        }
+    }
 
-            // Reset the force to zero
-            objects[i].f[dim] = 0;
+    // Velocity, position and boundary bounce of the same objects in one branchless pass
+    integrateBodies(begin, end, objects.data(), time_step, size_enclosure);
+}
 
-            // Update the position of the object
-            objects[i].p[dim] += objects[i].v[dim] * time_step;
+void updateObjects() {
+    updateObjWatch.start();
+    updateObjAllocs.start();
+    //std::printf("Updating dim %i, objects size %zi\n", dim, objectsSize);
+    const double objectsSize = (double)objects.size();
+    const int team = en_adaptive ? updateObjTeam.begin(objectsSize * (objectsSize - 1) / 2 + objectsSize) : omp_get_max_threads();
+#pragma omp parallel num_threads(team)
+    {
+        computeForces();
 
-            // Check for boundary bounce
-            if (objects[i].p[dim] > size_enclosure) {
-                objects[i].p[dim] = size_enclosure;
-                objects[i].v[dim] *= -1;
+        // Wait until all forces are computed, all positions are still the ones of the previous step
+#pragma omp barrier
+
+        moveObjects();
+    }
+    if (en_adaptive) {
+        updateObjTeam.end();
+    }
+    updateObjWatch.stop();
+    updateObjAllocs.stop();
+}
+
+// Barrier between two phases of the persistent time loop, the waiting time is the synchronization cost
+inline void phaseBarrier() {
+    const int tid = omp_get_thread_num();
+    syncThreadWatch[tid].start();
+#pragma omp barrier
+    syncThreadWatch[tid].stop();
+}
+
+// Add a frame to the trajectory after every trajEvery steps
+void writeTrajectory(size_t step) {
+    if (trajectory.isOpen() && step % trajEvery == 0) {
+        trajectory.frame(step, objects.size(), [&](size_t i, double* p) {
+            p[0] = objects[i].p[0];
+            p[1] = objects[i].p[1];
+            p[2] = objects[i].p[2];
+        });
+    }
+}
+
+// In-situ analysis of a step (every analysis_every steps)
+void writeAnalysis(size_t step) {
+    analysis.step(step, objects.size(), [&](size_t i, double& mass, double* p) {
+        mass = objects[i].mass;
+        p[0] = objects[i].p[0];
+        p[1] = objects[i].p[1];
+        p[2] = objects[i].p[2];
+    });
+}
+
+// Telemetry line of a step (every telemetry_every steps)
+void writeTelemetry(size_t step) {
+    telemetry.endStep(step, objects.size(), [&](size_t i, double& mass, double* v) {
+        mass = objects[i].mass;
+        v[0] = objects[i].v[0];
+        v[1] = objects[i].v[1];
+        v[2] = objects[i].v[2];
+    });
+}
+
+// Time loop with one fork/join for all iterations, the same team of threads runs every phase
+void runPersistent() {
+#pragma omp parallel
+    {
+        for (size_t iteration = 0; iteration < (unsigned)num_iterations; iteration++) {
+#pragma omp master
+            {
+                if (iteration == 1) {
+                    steadyAllocs.start();
+                }
+                telemetry.startStep(objects.size());
+                updateObjWatch.start();
+                updateObjAllocs.start();
             }
 
-            if (objects[i].p[dim] < 0) {
-                objects[i].p[dim] = 0;
-                objects[i].v[dim] *= -1;
+            computeForces();
+            phaseBarrier();
+            moveObjects();
+            phaseBarrier();
+
+#pragma omp master
+            {
+                updateObjWatch.stop();
+                updateObjAllocs.stop();
+                collisionWatch.start();
+                collisionAllocs.start();
             }
+
+            // Check for collisions (for all objects j < i)
+            findCollisions();
+            phaseBarrier();
+
+#pragma omp master
+            {
+                mergeCollisions();
+                collisionWatch.stop();
+                collisionAllocs.stop();
+                writeTelemetry(iteration + 1);
+                writeTrajectory(iteration + 1);
+                writeAnalysis(iteration + 1);
+            }
+            phaseBarrier();
         }
     }
-    updateObjWatch.stop();
 }
 
 int main(int argc, char** argv) {
@@ -133,13 +366,14 @@ int main(int argc, char** argv) {
     const char* arguments[5] = {"num_objects", "num_iterations",
                                 "random_seed", "size_enclosure", "time_step"};
 
-    // If an optional argument is provided and it matches en_benchmark, enable benchmark mode
-    if (argc == 7) {
-        std::string arg6(argv[6]);
-        if (arg6 == "en_benchmark") {
-            en_benchmark = true;
-        }
-    }
+    // Optional arguments (en_benchmark, en_sap, en_persistent, en_swept, en_deterministic, det_chunks=K, en_adaptive, en_numa, en_hugepages, init=file, en_philox, en_exact_config, traj=file, traj_every=K, traj_bits=B, traj_keyframe=F, telemetry=file, telemetry_every=K, analysis=prefix, analysis_every=K, analysis_kinds=list, en_alloc_check) follow the five positional ones
+    Options options(argc, argv, 6);
+    en_benchmark = options.has("en_benchmark");
+    en_sap = options.has("en_sap");
+    en_persistent = options.has("en_persistent");
+    en_swept = options.has("en_swept");
+    en_deterministic = options.has("en_deterministic");
+    en_adaptive = options.has("en_adaptive") && !en_persistent;
     if (!en_benchmark) {
         std::cout << "sim-paos invoked with " << argc - 1 << " parameters."
                   << "\n"
@@ -160,16 +394,33 @@ int main(int argc, char** argv) {
     }
 
     // Check the parameter count
-    if (argc < 6 || argc > 7) {
+    if (argc < 6) {
         std::cerr << "Error: Wrong number of parameters\n";
         return -1;
     }
+    std::string unknownOption = options.unknown({"en_benchmark", "en_sap", "en_persistent", "en_swept", "en_deterministic", "det_chunks", "en_adaptive", "en_numa", "en_hugepages", "init", "en_philox", "en_exact_config",
+                                                  "traj", "traj_every", "traj_bits", "traj_keyframe", "telemetry", "telemetry_every", "analysis", "analysis_every", "analysis_kinds", "en_alloc_check"});
+    if (!unknownOption.empty()) {
+        std::cerr << "Error: Unknown option " << unknownOption << "\n";
+        return -1;
+    }
+#ifndef TRACK_ALLOCS
+    if (options.has("en_alloc_check")) {
+        std::cerr << "Error: en_alloc_check needs a build with TRACK_ALLOCS\n";
+        return -1;
+    }
+#endif
 
     num_objects = std::stoi(argv[1]);
     num_iterations = std::stoi(argv[2]);
     seed = std::stoull(argv[3]);
     size_enclosure = std::stod(argv[4]);
     time_step = std::stod(argv[5]);
+    trajEvery = std::stoull(options.get("traj_every", "1"));
+    const int trajBits = std::stoi(options.get("traj_bits", "20"));
+    const size_t telemetryEvery = std::stoull(options.get("telemetry_every", "1"));
+    const size_t analysisEvery = std::stoull(options.get("analysis_every", "100"));
+    deterministicChunks = std::stoull(options.get("det_chunks", "64"));
 
     if (num_objects < 0) {
         std::cerr << "Error: Invalid number of objects\n";
@@ -190,52 +441,194 @@ int main(int argc, char** argv) {
         std::cerr << "Error: Invalid time increment\n";
         return -2;
     }
+    if (trajEvery == 0) {
+        std::cerr << "Error: Invalid trajectory interval\n";
+        return -2;
+    }
+    if (trajBits < 1 || trajBits > 32) {
+        std::cerr << "Error: Invalid trajectory precision\n";
+        return -2;
+    }
+    if (telemetryEvery == 0) {
+        std::cerr << "Error: Invalid telemetry interval\n";
+        return -2;
+    }
+    if (analysisEvery == 0) {
+        std::cerr << "Error: Invalid analysis interval\n";
+        return -2;
+    }
+    if (deterministicChunks == 0) {
+        std::cerr << "Error: Invalid number of deterministic chunks\n";
+        return -2;
+    }
 
-    // Initialize the RNG
-    std::mt19937_64 gen(seed);
-    std::uniform_real_distribution<> uniform_distr(0, size_enclosure);
-    std::normal_distribution<double> normal_distr(1E21, 1E15);
+    // Pin the threads and let them touch the memory of the objects first, so every page is placed
+    // on the socket of the thread that updates those objects
+    if (options.has("en_numa")) {
+        pinThreads();
+        numaSettings.firstTouch = true;
+    }
+    numaSettings.hugePages = options.has("en_hugepages");
+
+    // Read the objects from the init file, or generate them with random mass and position
+    if (options.has("init")) {
+        Config config;
+        std::string error = loadConfig(options.get("init"), config);
+        if (!error.empty()) {
+            std::cerr << "Error: " << error << "\n";
+            return -3;
+        }
+        num_objects = (int)config.size();
+        objects.resize(config.size());
+        for (size_t i = 0; i < config.size(); i++) {
+            objects[i] = Object(config.mass[i], config.x[i], config.y[i], config.z[i]);
+            objects[i].v[0] = config.vx[i];
+            objects[i].v[1] = config.vy[i];
+            objects[i].v[2] = config.vz[i];
+        }
+    } else if (options.has("en_philox")) {
+        // Every object only depends on (seed, i), so they can be generated in any order
+        Philox rng(seed);
+        objects.resize(num_objects);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < num_objects; i++) {
+            double x, y, z, m;
+            philoxObject(rng, i, size_enclosure, x, y, z, m);
+            objects[i] = Object(m, x, y, z);
+        }
+    } else {
+        // Initialize the RNG
+        std::mt19937_64 gen(seed);
+        std::uniform_real_distribution<> uniform_distr(0, size_enclosure);
+        std::normal_distribution<double> normal_distr(1E21, 1E15);
+
+        // Create the necessary amount of objects and store them in a vector of class Object
+        objects.resize(num_objects);
+        auto rnd_object = [&gen, &uniform_distr, &normal_distr] {
+            double x = uniform_distr(gen);
+            double y = uniform_distr(gen);
+            double z = uniform_distr(gen);
+            double m = normal_distr(gen);
+            return Object(m, x, y, z);
+        };
+        std::generate(objects.begin(), objects.end(), rnd_object);
+    }
 
-    // Create the necessary amount of objects and store them in a vector of class Object
-    objects.resize(num_objects);
-    auto rnd_object = [&gen, &uniform_distr, &normal_distr] {
-        double x = uniform_distr(gen);
-        double y = uniform_distr(gen);
-        double z = uniform_distr(gen);
-        double m = normal_distr(gen);
-        return Object(m, x, y, z);
-    };
-    std::generate(objects.begin(), objects.end(), rnd_object);
+    // Allocate the force buffer (by the thread itself) and stopwatch of every thread (the number of objects only decreases),
+    // with en_deterministic a buffer per chunk
+    forceBuffers.resize(en_deterministic ? deterministicChunks : omp_get_max_threads());
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < (int)forceBuffers.size(); b++) {
+        forceBuffers[b].assign(3 * objects.size(), 0);
+    }
+    forceThreadWatch.resize(omp_get_max_threads());
+    collisionThreadWatch.resize(omp_get_max_threads());
+    syncThreadWatch.resize(omp_get_max_threads());
+
+    // Fork/join cost of the full team, the phases use fewer threads when the work left doesn't pay for it
+    if (en_adaptive) {
+        updateObjTeam.calibrate(omp_get_max_threads());
+        collisionTeam = updateObjTeam;
+    }
+
+    // Start positions of the swept collision check
+    if (en_swept) {
+        previousPositions.assign(3 * objects.size(), 0);
+    }
+
+    // Room for one collision per object, the collision check only allocates in steps with more
+    toRemove.reserve(objects.size());
 
     // Check for collisions before starting
     checkCollisions();
+    sweptReady = en_swept;
+
+    // Values of object i as printed in the config files
+    auto getConfigValues = [&](size_t i, double* values) {
+        values[0] = objects[i].p[0];
+        values[1] = objects[i].p[1];
+        values[2] = objects[i].p[2];
+        values[3] = objects[i].v[0];
+        values[4] = objects[i].v[1];
+        values[5] = objects[i].v[2];
+        values[6] = objects[i].mass;
+    };
 
     // Print the initial config
-    std::ofstream initial;
-    initial.open("init_config.txt");
-    initial << std::fixed << std::setprecision(3) << size_enclosure << " " << time_step << " " << objects.size() << "\n";
-    for (const auto& i : objects) {
-        initial << std::fixed << std::setprecision(3) << i.p[0] << " " << i.p[1] << " " << i.p[2] << " " << i.v[0] << " " << i.v[1] << " " << i.v[2] << " " << i.mass << "\n";
+    if (!writeConfig("init_config.txt", size_enclosure, time_step, objects.size(), getConfigValues, options.has("en_exact_config"))) {
+        std::cerr << "Error: Can't write init_config.txt\n";
+        return -3;
+    }
+
+    // Start the trajectory with the initial positions
+    if (options.has("traj")) {
+        if (!trajectory.open(options.get("traj"), size_enclosure, time_step, trajBits, std::stoul(options.get("traj_keyframe", "100")),
+                             objects.size(), num_iterations / trajEvery + 1)) {
+            std::cerr << "Error: Can't write " << options.get("traj") << "\n";
+            return -3;
+        }
+        writeTrajectory(0);
+    }
+
+    // Conserved quantities and speed of the time loop
+    if (options.has("telemetry") && !telemetry.open(options.get("telemetry"), telemetryEvery)) {
+        std::cerr << "Error: Can't write " << options.get("telemetry") << "\n";
+        return -3;
+    }
+
+    // Analysis of the initial objects, then every analysis_every steps
+    if (options.has("analysis")) {
+        std::string error = analysis.open(options.get("analysis"), options.get("analysis_kinds", "radial,spectrum,largest"), analysisEvery, size_enclosure, objects.size());
+        if (!error.empty()) {
+            std::cerr << "Error: " << error << "\n";
+            return -3;
+        }
+        writeAnalysis(0);
     }
-    initial.close();
 
     // Time loop
-    for (size_t iteration = 0; iteration < (unsigned)num_iterations; iteration++) {
-        updateObjects();
+    if (en_persistent) {
+        runPersistent();
+    } else {
+        for (size_t iteration = 0; iteration < (unsigned)num_iterations; iteration++) {
+            if (iteration == 1) {
+                steadyAllocs.start();
+            }
+            telemetry.startStep(objects.size());
+
+            updateObjects();
+
+            // Check for collisions (for all objects j < i)
+            checkCollisions();
 
-        // Check for collisions (for all objects j < i)
-        checkCollisions();
+            writeTelemetry(iteration + 1);
+            writeTrajectory(iteration + 1);
+            writeAnalysis(iteration + 1);
+        }  // END OF TIME LOOP
+    }
 
-    }  // END OF TIME LOOP
+    // The steps after the first one must not allocate (the buffers only grow in the first step)
+    if (num_iterations > 1) {
+        steadyAllocs.stop();
+    }
+    if (options.has("en_alloc_check") && steadyAllocs.getCount() > 0) {
+        std::cerr << "Error: " << steadyAllocs.getCount() << " heap allocations after the first step\n";
+        return -4;
+    }
 
     // Printing final config
-    std::ofstream final;
-    final.open("final_config.txt");
-    final << std::fixed << std::setprecision(3) << size_enclosure << " " << time_step << " " << objects.size() << "\n";
-    for (const auto& i : objects) {
-        final << std::fixed << std::setprecision(3) << i.p[0] << " " << i.p[1] << " " << i.p[2] << " " << i.v[0] << " " << i.v[1] << " " << i.v[2] << " " << i.mass << "\n";
+    if (!writeConfig("final_config.txt", size_enclosure, time_step, objects.size(), getConfigValues, options.has("en_exact_config"))) {
+        std::cerr << "Error: Can't write final_config.txt\n";
+        return -3;
+    }
+    if (!trajectory.close()) {
+        std::cerr << "Error: Can't write " << options.get("traj") << "\n";
+        return -3;
+    }
+    if (!analysis.close()) {
+        std::cerr << "Error: Can't write the analysis files of " << options.get("analysis") << "\n";
+        return -3;
     }
-    final.close();
 
     // Measure execution time and print it
     totalWatch.stop();
@@ -251,6 +644,17 @@ int main(int argc, char** argv) {
                     collisionWatch.getCount() / 1000000.0,
                     collisionTimeRel,
                     100.0 - updateObjRel - collisionTimeRel);
+        printThreadBalance("UpdateObj pairs", forceThreadWatch);
+        printThreadBalance("Collision pairs", collisionThreadWatch);
+        const char* allocNames[3] = { "UpdateObj", "Collision", "after the first step" };
+        const allocWatch allocs[3] = { updateObjAllocs, collisionAllocs, steadyAllocs };
+        printAllocations(allocNames, allocs, 3);
+        if (en_persistent) {
+            printSyncCost(syncThreadWatch, num_iterations);
+        }
+        if (en_adaptive) {
+            printAdaptiveThreads(updateObjTeam, collisionTeam);
+        }
     }
 
     return 0;
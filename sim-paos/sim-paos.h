@@ -14,6 +14,19 @@
 
 #include "object.h"
 #include "../common/watch.h"
+#include "../common/adaptive.h"
+#include "../common/allocs.h"
+#include "../common/analysis.h"
 #include "../common/pair.h"
+#include "../common/config_io.h"
+#include "../common/numa.h"
+#include "../common/options.h"
+#include "../common/integrate.h"
+#include "../common/philox.h"
+#include "../common/partition.h"
+#include "../common/sweep.h"
+#include "../common/swept.h"
+#include "../common/telemetry.h"
+#include "../common/trajectory.h"
 
 #define G 6.674E-11
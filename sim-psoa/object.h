@@ -1,8 +1,13 @@
 #pragma once
 
 #include <cmath>
+#include <random>
 #include <vector>
 
+#include "../common/config_io.h"
+#include "../common/philox.h"
+#include "../common/numa.h"
+
 #define sqr(a) (a)*(a)
 #define cube(a) (a)*(a)*(a)
 
@@ -16,22 +21,25 @@ struct Object {
 
 	std::vector <bool> removeFlag;
 
-	std::vector <double> mass;
+	numa_vector <double> mass;
+
+	numa_vector <double> x;
+	numa_vector <double> y;
+	numa_vector <double> z;
 
-	std::vector <double> x;
-	std::vector <double> y;
-	std::vector <double> z;
+	numa_vector <double> vx;
+	numa_vector <double> vy;
+	numa_vector <double> vz;
 
-	std::vector <double> vx;
-	std::vector <double> vy;
-	std::vector <double> vz;
+	numa_vector <double> fx;
+	numa_vector <double> fy;
+	numa_vector <double> fz;
 
-	std::vector <double> fx;
-	std::vector <double> fy;
-	std::vector <double> fz;
+	// No objects (a Simulation before init)
+	Object() : size(0) {}
 
-	// Constructor
-	Object(const size_t size, const uint64_t seed, const double size_enclosure) : size(size),
+	// Constructor, without the force arrays if forces is false (en_lean)
+	Object(const size_t size, const uint64_t seed, const double size_enclosure, const bool en_philox = false, const bool forces = true) : size(size),
 		removeFlag(size,false),
 		mass(size),
 		x(size),
@@ -40,10 +48,20 @@ struct Object {
 		vx(size),
 		vy(size),
 		vz(size),
-		fx(size),
-		fy(size),
-		fz(size)
+		fx(forces ? size : 0),
+		fy(forces ? size : 0),
+		fz(forces ? size : 0)
 	{
+		if (en_philox) {
+			// Every object only depends on (seed, i), so they can be generated in any order
+			Philox rng(seed);
+			#pragma omp parallel for schedule(static)
+			for (int i = 0; i < (int)size; ++i) {
+				philoxObject(rng, i, size_enclosure, x[i], y[i], z[i], mass[i]);
+			}
+			return;
+		}
+
 		// Initialize the RNG
 		std::mt19937_64 gen(seed);
 		std::uniform_real_distribution<> uniform_distr(0, size_enclosure);
@@ -58,6 +76,22 @@ struct Object {
 		}
 	}
 
+	// Constructor from the objects of a config file
+	Object(const Config& config, const bool forces = true) : size(config.size()),
+		removeFlag(size, false),
+		mass(config.mass.begin(), config.mass.end()),
+		x(config.x.begin(), config.x.end()),
+		y(config.y.begin(), config.y.end()),
+		z(config.z.begin(), config.z.end()),
+		vx(config.vx.begin(), config.vx.end()),
+		vy(config.vy.begin(), config.vy.end()),
+		vz(config.vz.begin(), config.vz.end()),
+		fx(forces ? size : 0),
+		fy(forces ? size : 0),
+		fz(forces ? size : 0)
+	{
+	}
+
 	// Reset the forces to zero
 	inline void reset_forces() {
 		std::fill(fx.begin(), fx.end(), 0);
@@ -65,34 +99,6 @@ struct Object {
 		std::fill(fz.begin(), fz.end(), 0);
 	}
 
-	// Keep objects inside the boundary
-	inline void adjust_for_boundary(const double size_enclosure, const size_t i) {
-		if (x[i] < 0) {
-			x[i] = 0;
-			vx[i] *= -1;
-		}
-		if (x[i] > size_enclosure) {
-			x[i] = size_enclosure;
-			vx[i] *= -1;
-		}
-		if (y[i] < 0) {
-			y[i] = 0;
-			vy[i] *= -1;
-		}
-		if (y[i] > size_enclosure) {
-			y[i] = size_enclosure;
-			vy[i] *= -1;
-		}
-		if (z[i] < 0) {
-			z[i] = 0;
-			vz[i] *= -1;
-		}
-		if (z[i] > size_enclosure) {
-			z[i] = size_enclosure;
-			vz[i] *= -1;
-		}
-	}
-
 	// j merges into i (j deleted)
 	inline void delete_object(size_t j) {
 		removeFlag.erase(removeFlag.begin() + j);
@@ -103,9 +109,11 @@ struct Object {
 		vx.erase(vx.begin() + j);
 		vy.erase(vy.begin() + j);
 		vz.erase(vz.begin() + j);
-		fx.erase(fx.begin() + j);
-		fy.erase(fy.begin() + j);
-		fz.erase(fz.begin() + j);
+		if (!fx.empty()) {
+			fx.erase(fx.begin() + j);
+			fy.erase(fy.begin() + j);
+			fz.erase(fz.begin() + j);
+		}
 
 		size--;
 	}
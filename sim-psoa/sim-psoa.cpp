@@ -6,84 +6,102 @@
     int num_objects;
     int num_iterations;
     uint64_t seed;
-    double size_enclosure;
-    double time_step;
     bool en_benchmark = false;
+    size_t trajEvery = 1;         // Steps between two trajectory frames
 
 // FUNCTIONS
 
 // Watch class used for easy benchmarking
-watch collisionWatch, updateObjWatch, totalWatch;
+watch totalWatch;
 
-// Compare the pairs as if they were executed in sequential order (i first then j)
-inline bool operator<(const Pair& p1, const Pair& p2) {
-    return (p1.j - p1.i * num_objects) < (p2.j - p2.i * num_objects);
-}
+// Heap allocations of all steps after the first one (only counted with TRACK_ALLOCS)
+allocWatch steadyAllocs;
 
-// Checks for collisions between object i and objects 0 to i - 1
-void checkCollisions(Object& objects) {
-    collisionWatch.start();
+// Positions written every trajEvery steps (only with traj=file)
+TrajectoryWriter trajectory;
 
-    // TO ADD: NO CHECKING FOR REMOVING IF NOTHING HAS MERGED
+// Conserved quantities and speed (only with telemetry=file), cutoffInteractions at the start of the step
+Telemetry telemetry;
+uint64_t telemetryInteractions = 0;
 
-    std::set<Pair> toRemove;
+// Radial profile, mass spectrum and largest bodies every analysis_every steps (only with analysis=prefix)
+InSituAnalysis analysis;
 
-    #pragma omp parallel for schedule(guided)
-    for (int i = 0; i < (int)objects.size; i++) {
-        for (int j = i - 1; j >= 0; j--) {
-            if (dst_sqr(&objects, i,j) < 1) {
-                #pragma omp critical
-                toRemove.emplace(i, j);
-            }
+// Printing (only in debug)
+void printObjects(const ObjectsView& object, size_t iteration) {
+#ifndef NDEBUG
+    std::printf("it %d\t  x\t\t  y\t\t  z\n", (int)iteration);
+    unsigned int j = 0;
+    for (size_t i = 0; i < object.size; i++) {
+        if (object.fx != nullptr) {
+            std::printf("%04d: f: %.2E \t%.2E \t%.2E\n", j, object.fx[i], object.fy[i], object.fz[i]);
         }
+        std::printf("%04d: p: %.2E \t%.2E \t%.2E\n", j, object.x[i], object.y[i], object.z[i]);
+        std::printf("%04d: v: %.2E \t%.2E \t%.2E\n\n", j, object.vx[i], object.vy[i], object.vz[i]);
+        j++;
     }
-
-
-    // All collisions have been detected, now merge the collided objects
-    bool needRemoval = !toRemove.empty();
-    while (!toRemove.empty()) {
-        // Retrieve & remove the last element from the set
-        auto it = std::prev(toRemove.end());
-        auto i = (*it).i;
-        auto j = (*it).j;
-        toRemove.erase(it);
-
-        if (objects.removeFlag[j]) {
-            continue;
-        }
-        objects.removeFlag[j] = true;
-
-        objects.mass[i] += objects.mass[j];
-        objects.vx[i] += objects.vx[j];
-        objects.vy[i] += objects.vy[j];
-        objects.vz[i] += objects.vz[j];
-
-        //std::printf("\tMerging %zi -> %zi\n", j,i);
+    if (object.size > 1) {
+        std::printf("Distance (0-1) %.2E\n", std::sqrt(sqr(object.x[0] - object.x[1]) + sqr(object.y[0] - object.y[1]) + sqr(object.z[0] - object.z[1])));
     }
+#else
+    (void)object;
+    (void)iteration;
+#endif
+}
 
-    // Remove elements (only if something has merged)
-    if (needRemoval) {
-        for (size_t i = 0; i < objects.size; i++) {
-            if (objects.removeFlag[i]) {
-                objects.delete_object(i--);
-            }
-        }
+// Add a frame to the trajectory after every trajEvery steps
+void writeTrajectory(const ObjectsView& objects, size_t step) {
+    if (trajectory.isOpen() && step % trajEvery == 0) {
+        trajectory.frame(step, objects.size, [&](size_t i, double* p) {
+            p[0] = objects.x[i];
+            p[1] = objects.y[i];
+            p[2] = objects.z[i];
+        });
     }
-    collisionWatch.stop();
 }
 
+// In-situ analysis of a step (every analysis_every steps)
+void writeAnalysis(const ObjectsView& objects, size_t step) {
+    analysis.step(step, objects.size, [&](size_t i, double& mass, double* p) {
+        mass = objects.mass[i];
+        p[0] = objects.x[i];
+        p[1] = objects.y[i];
+        p[2] = objects.z[i];
+    });
+}
+
+// Telemetry line of a step (every telemetry_every steps)
+void writeTelemetry(const Simulation& simulation, size_t step) {
+    const ObjectsView objects = simulation.objects();
+    telemetry.endStep(step, objects.size, [&](size_t i, double& mass, double* v) {
+        mass = objects.mass[i];
+        v[0] = objects.vx[i];
+        v[1] = objects.vy[i];
+        v[2] = objects.vz[i];
+    }, simulation.settings().cutoff > 0 ? (simulation.stats.cutoffInteractions - telemetryInteractions) / 2.0 : -1);
+}
+
+// Thin wrapper around the Simulation library: arguments, config files, trajectory, telemetry and the timings
 int main(int argc, char** argv) {
     totalWatch.start();
 
     // Check the input parameters
     const char* arguments[5] = {"num_objects", "num_iterations",
                                 "random_seed", "size_enclosure", "time_step"};
-    if (argc == 7) {
-        std::string arg6(argv[6]);
-        if (arg6 == "en_benchmark") {
-            en_benchmark = true;
-        }
-    }
+
+    // Optional arguments (en_benchmark, en_sap, en_persistent, en_swept, en_deterministic, det_chunks=K, en_adaptive, en_lean, en_numa, en_hugepages, cutoff=R, en_smooth, init=file, en_philox, en_exact_config, storage=dir, en_stream, stream_block=N, traj=file, traj_every=K, traj_bits=B, traj_keyframe=F, telemetry=file, telemetry_every=K, analysis=prefix, analysis_every=K, analysis_kinds=list, en_alloc_check) follow the five positional ones
+    Options options(argc, argv, 6);
+    en_benchmark = options.has("en_benchmark");
+    SimulationSettings settings;
+    settings.en_sap = options.has("en_sap");
+    settings.en_persistent = options.has("en_persistent");
+    settings.en_swept = options.has("en_swept");
+    settings.en_deterministic = options.has("en_deterministic");
+    settings.en_adaptive = options.has("en_adaptive");
+    settings.en_lean = options.has("en_lean");
+    settings.en_smooth = options.has("en_smooth");
+    storageSettings.directory = options.get("storage");
+    settings.en_stream = options.has("en_stream") || options.has("storage");
     if (!en_benchmark) {
         std::cout << "sim-psoa invoked with " << argc - 1 << " parameters."
                   << "\n"
@@ -104,16 +122,36 @@ int main(int argc, char** argv) {
     }
 
     // Check the parameter count
-    if (argc < 6 || argc > 7) {
+    if (argc < 6) {
         std::cerr << "Error: Wrong number of parameters\n";
         return -1;
     }
+    std::string unknownOption = options.unknown({"en_benchmark", "en_sap", "en_persistent", "en_swept", "en_deterministic", "det_chunks", "en_adaptive", "en_lean", "en_numa", "en_hugepages",
+                                                  "cutoff", "en_smooth", "init", "en_philox", "en_exact_config", "storage", "en_stream", "stream_block",
+                                                  "traj", "traj_every", "traj_bits", "traj_keyframe", "telemetry", "telemetry_every", "analysis", "analysis_every", "analysis_kinds", "en_alloc_check"});
+    if (!unknownOption.empty()) {
+        std::cerr << "Error: Unknown option " << unknownOption << "\n";
+        return -1;
+    }
+#ifndef TRACK_ALLOCS
+    if (options.has("en_alloc_check")) {
+        std::cerr << "Error: en_alloc_check needs a build with TRACK_ALLOCS\n";
+        return -1;
+    }
+#endif
 
     num_objects = std::stoi(argv[1]);
     num_iterations = std::stoi(argv[2]);
     seed = std::stoull(argv[3]);
-    size_enclosure = std::stod(argv[4]);
-    time_step = std::stod(argv[5]);
+    settings.size_enclosure = std::stod(argv[4]);
+    settings.time_step = std::stod(argv[5]);
+    settings.cutoff = std::stod(options.get("cutoff", "0"));
+    settings.streamBlock = std::stoull(options.get("stream_block", "262144"));
+    settings.deterministicChunks = std::stoull(options.get("det_chunks", "64"));
+    trajEvery = std::stoull(options.get("traj_every", "1"));
+    const int trajBits = std::stoi(options.get("traj_bits", "20"));
+    const size_t telemetryEvery = std::stoull(options.get("telemetry_every", "1"));
+    const size_t analysisEvery = std::stoull(options.get("analysis_every", "100"));
 
     if (num_objects < 0) {
         std::cerr << "Error: Invalid number of objects\n";
@@ -124,119 +162,171 @@ int main(int argc, char** argv) {
         return -2;
     }
 
-    // Seed is already an unsigned 64 bit integer, no need to check for validity
+    // Seed is already an unsigned 64 bit integer, no need to check for validity, the simulation checks the other settings
 
-    if (size_enclosure < 0) {
-        std::cerr << "Error: Invalid box size\n";
+    if (trajEvery == 0) {
+        std::cerr << "Error: Invalid trajectory interval\n";
+        return -2;
+    }
+    if (trajBits < 1 || trajBits > 32) {
+        std::cerr << "Error: Invalid trajectory precision\n";
         return -2;
     }
-    if (time_step < 0) {
-        std::cerr << "Error: Invalid time increment\n";
+    if (telemetryEvery == 0) {
+        std::cerr << "Error: Invalid telemetry interval\n";
+        return -2;
+    }
+    if (analysisEvery == 0) {
+        std::cerr << "Error: Invalid analysis interval\n";
         return -2;
     }
 
-    // Generate Object; assign random values to mass and position
-    Object object((size_t)num_objects, seed, size_enclosure);
+    // Pin the threads and let them touch the memory of the objects first, so every page is placed
+    // on the socket of the thread that updates those objects
+    if (options.has("en_numa")) {
+        pinThreads();
+        numaSettings.firstTouch = true;
+    }
+    numaSettings.hugePages = options.has("en_hugepages");
+
+    // Read the objects from the init file, or generate them; the objects that collide are merged right away
+    Simulation simulation;
+    std::string error;
+    if (options.has("init")) {
+        Config config;
+        error = loadConfig(options.get("init"), config);
+        if (!error.empty()) {
+            std::cerr << "Error: " << error << "\n";
+            return -3;
+        }
+        num_objects = (int)config.size();
+        error = simulation.init(settings, config);
+    } else {
+        error = simulation.init(settings, (size_t)num_objects, seed, options.has("en_philox"));
+    }
+    if (!error.empty()) {
+        std::cerr << "Error: " << error << "\n";
+        return -2;
+    }
 
-    // Check for collisions before starting
-    checkCollisions(object);
+    // Values of object i as printed in the config files
+    auto getConfigValues = [&](size_t i, double* values) {
+        const ObjectsView object = simulation.objects();
+        values[0] = object.x[i];
+        values[1] = object.y[i];
+        values[2] = object.z[i];
+        values[3] = object.vx[i];
+        values[4] = object.vy[i];
+        values[5] = object.vz[i];
+        values[6] = object.mass[i];
+    };
 
     // Print the initial config
-    std::ofstream initial;
-    initial.open("init_config.txt");
-    initial << std::fixed << std::setprecision(3) << size_enclosure << " " << time_step << " " << object.size << "\n";
-    for (size_t i = 0; i < object.size; ++i) {
-        initial << std::fixed << std::setprecision(3) << object.x[i] << " " << object.y[i] << " " << object.z[i] << " " << object.vx[i] << " " << object.vy[i] << " " << object.vz[i] << " " << object.mass[i] << "\n";
-    }
-    initial.close();
-
-    // Time loop
-    for (size_t iteration = 0; iteration < (unsigned)num_iterations; iteration++) {
-        // Start stopwatch
-        updateObjWatch.start();
-
-        // Reset all forces to zero
-        object.reset_forces();
-
-        // Calculate the force, change in velocity and position
-        for (size_t i = 0; i < object.size; i++) {
-            for (size_t j = i + 1; j < object.size; j++) {
-                double massGravDist = object.mass[i] * object.mass[j] * G / dst_cube(&object, i, j);
-                double fx = massGravDist * (object.x[j] - object.x[i]);
-                double fy = massGravDist * (object.y[j] - object.y[i]);
-                double fz = massGravDist * (object.z[j] - object.z[i]);
-
-                object.fx[i] += fx;
-                object.fx[j] -= fx;
-                object.fy[i] += fy;
-                object.fy[j] -= fy;
-                object.fz[i] += fz;
-                object.fz[j] -= fz;
-            }
-
-            // All forces on objects[i] are now computed, calculate the velocity change
-            // F=ma -> a=F/m
-            // dv=a*dt -> dv=F/m*dt
-
-            object.vx[i] += object.fx[i] / object.mass[i] * time_step;
-            object.vy[i] += object.fy[i] / object.mass[i] * time_step;
-            object.vz[i] += object.fz[i] / object.mass[i] * time_step;
-
-            // Update the position of the object
-
-            object.x[i] += object.vx[i] * time_step;
-            object.y[i] += object.vy[i] * time_step;
-            object.z[i] += object.vz[i] * time_step;
-
-            // If objects are outside of boundary, set them to the perimeter
+    if (!writeConfig("init_config.txt", settings.size_enclosure, settings.time_step, simulation.size(), getConfigValues, options.has("en_exact_config"))) {
+        std::cerr << "Error: Can't write init_config.txt\n";
+        return -3;
+    }
 
-            object.adjust_for_boundary(size_enclosure, i);
+    // Start the trajectory with the initial positions
+    if (options.has("traj")) {
+        if (!trajectory.open(options.get("traj"), settings.size_enclosure, settings.time_step, trajBits, std::stoul(options.get("traj_keyframe", "100")),
+                             simulation.size(), num_iterations / trajEvery + 1)) {
+            std::cerr << "Error: Can't write " << options.get("traj") << "\n";
+            return -3;
         }
-        updateObjWatch.stop();
+        writeTrajectory(simulation.objects(), 0);
+    }
 
-        checkCollisions(object);
+    // Conserved quantities and speed of the time loop
+    if (options.has("telemetry") && !telemetry.open(options.get("telemetry"), telemetryEvery)) {
+        std::cerr << "Error: Can't write " << options.get("telemetry") << "\n";
+        return -3;
+    }
 
-        // Printing (only in debug)
-#ifndef NDEBUG
-        std::printf("it %d\t  x\t\t  y\t\t  z\n", (int)iteration);
-        unsigned int j = 0;
-        for (size_t i = 0; i < object.size; i++) {
-            std::printf("%04d: f: %.2E \t%.2E \t%.2E\n", j, object.fx[i], object.fy[i], object.fz[i]);
-            std::printf("%04d: p: %.2E \t%.2E \t%.2E\n", j, object.x[i], object.y[i], object.z[i]);
-            std::printf("%04d: v: %.2E \t%.2E \t%.2E\n\n", j, object.vx[i], object.vy[i], object.vz[i]);
-            j++;
+    // Analysis of the initial objects, then every analysis_every steps
+    if (options.has("analysis")) {
+        error = analysis.open(options.get("analysis"), options.get("analysis_kinds", "radial,spectrum,largest"), analysisEvery, settings.size_enclosure, simulation.size());
+        if (!error.empty()) {
+            std::cerr << "Error: " << error << "\n";
+            return -3;
         }
-        if (object.size > 1) {
-            std::printf("Distance (0-1) %.2E\n", std::sqrt(dst_sqr(&object, 0, 1)));
-        }
-#endif
+        writeAnalysis(simulation.objects(), 0);
+    }
 
-    }  // End time loop
+    // Time loop, the output of every step is written between the steps
+    simulation.removed = [&](size_t i) {
+        trajectory.remove(i);
+    };
+    simulation.beforeStep = [&](size_t step) {
+        if (step == 2) {
+            steadyAllocs.start();
+        }
+        telemetry.startStep(simulation.size());
+        telemetryInteractions = simulation.stats.cutoffInteractions;
+    };
+    simulation.afterStep = [&](size_t step) {
+        printObjects(simulation.objects(), step - 1);
+        writeTelemetry(simulation, step);
+        writeTrajectory(simulation.objects(), step);
+        writeAnalysis(simulation.objects(), step);
+    };
+    simulation.step(num_iterations);
+
+    // The steps after the first one must not allocate (the buffers only grow in the first step)
+    if (num_iterations > 1) {
+        steadyAllocs.stop();
+    }
+    if (options.has("en_alloc_check") && steadyAllocs.getCount() > 0) {
+        std::cerr << "Error: " << steadyAllocs.getCount() << " heap allocations after the first step\n";
+        return -4;
+    }
 
     // Printing final config
-    std::ofstream final;
-    final.open("final_config.txt");
-    final << std::fixed << std::setprecision(3) << size_enclosure << " " << time_step << " " << object.size << "\n";
-    for (size_t i = 0; i < object.size; ++i) {
-        final << std::fixed << std::setprecision(3) << object.x[i] << " " << object.y[i] << " " << object.z[i] << " " << object.vx[i] << " " << object.vy[i] << " " << object.vz[i] << " " << object.mass[i] << "\n";
+    if (!writeConfig("final_config.txt", settings.size_enclosure, settings.time_step, simulation.size(), getConfigValues, options.has("en_exact_config"))) {
+        std::cerr << "Error: Can't write final_config.txt\n";
+        return -3;
+    }
+    if (!trajectory.close()) {
+        std::cerr << "Error: Can't write " << options.get("traj") << "\n";
+        return -3;
+    }
+    if (!analysis.close()) {
+        std::cerr << "Error: Can't write the analysis files of " << options.get("analysis") << "\n";
+        return -3;
     }
-    final.close();
 
     // Measure execution time and print it
     totalWatch.stop();
+    SimulationStatistics& stats = simulation.stats;
     if (en_benchmark) {
         std::printf("%f", totalWatch.getCount() / 1000000.0);
     }
     else {
-        double updateObjRel = (double)updateObjWatch.getCount() / totalWatch.getCount() * 100;
-        double collisionTimeRel = (double)collisionWatch.getCount() / totalWatch.getCount() * 100;
+        double updateObjRel = (double)stats.updateObj.getCount() / totalWatch.getCount() * 100;
+        double collisionTimeRel = (double)stats.collision.getCount() / totalWatch.getCount() * 100;
         std::printf("Total execution time: %.1fms: UpdateObjTime %.1fms (%.1f%%), CollisionTime %.1fms (%.1f%%), Others (%.1f%%)\n",
             totalWatch.getCount() / 1000000.0,
-            updateObjWatch.getCount() / 1000000.0,
+            stats.updateObj.getCount() / 1000000.0,
             updateObjRel,
-            collisionWatch.getCount() / 1000000.0,
+            stats.collision.getCount() / 1000000.0,
             collisionTimeRel,
             100.0 - updateObjRel - collisionTimeRel);
+        printThreadBalance("UpdateObj pairs", stats.forceThreads);
+        printThreadBalance("Collision pairs", stats.collisionThreads);
+        const char* allocNames[3] = { "UpdateObj", "Collision", "after the first step" };
+        const allocWatch allocs[3] = { stats.updateObjAllocs, stats.collisionAllocs, steadyAllocs };
+        printAllocations(allocNames, allocs, 3);
+        if (settings.en_persistent) {
+            printSyncCost(stats.syncThreads, num_iterations);
+        } else if (settings.en_adaptive) {
+            printAdaptiveThreads(stats.updateObjTeam, stats.collisionTeam);
+        }
+        if (settings.cutoff > 0 && num_iterations > 0) {
+            // Every pair within the cutoff radius is computed by both objects
+            std::printf("Cutoff pairs per step: %.0f (all pairs at the start: %.0f)\n",
+                stats.cutoffInteractions / 2.0 / num_iterations,
+                num_objects * (num_objects - 1.0) / 2);
+        }
     }
     return 0;
 }
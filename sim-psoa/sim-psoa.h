@@ -9,12 +9,15 @@
 #include <string>  //needed for conversing argv
 #include <vector>
 #include <omp.h>
-#include <queue>
-#include <set>
 
-#include "object.h"
+#include "simulation.h"
 #include "../common/watch.h"
-#include "../common/pair.h"
-
-#define G 6.674E-11
+#include "../common/allocs.h"
+#include "../common/analysis.h"
+#include "../common/config_io.h"
+#include "../common/numa.h"
+#include "../common/options.h"
+#include "../common/storage.h"
+#include "../common/telemetry.h"
+#include "../common/trajectory.h"
 
@@ -0,0 +1,619 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <omp.h>
+
+#include "../common/integrate.h"
+#include "../common/partition.h"
+#include "../common/storage.h"
+
+#define G 6.674E-11
+
+std::string Simulation::init(const SimulationSettings& settings, const size_t num_objects, const uint64_t seed, const bool en_philox) {
+    config = settings;
+    if (config.size_enclosure < 0) {
+        return "Invalid box size";
+    }
+    object = Object(num_objects, seed, config.size_enclosure, en_philox, !config.en_lean);
+    return start();
+}
+
+std::string Simulation::init(const SimulationSettings& settings, const Config& objects) {
+    config = settings;
+    object = Object(objects, !config.en_lean);
+    return start();
+}
+
+std::string Simulation::init(const SimulationSettings& settings, const size_t n, const double* mass, const double* x, const double* y, const double* z,
+                             const double* vx, const double* vy, const double* vz) {
+    Config objects;
+    objects.mass.assign(mass, mass + n);
+    objects.x.assign(x, x + n);
+    objects.y.assign(y, y + n);
+    objects.z.assign(z, z + n);
+    objects.vx.assign(n, 0);
+    objects.vy.assign(n, 0);
+    objects.vz.assign(n, 0);
+    if (vx != nullptr && vy != nullptr && vz != nullptr) {
+        objects.vx.assign(vx, vx + n);
+        objects.vy.assign(vy, vy + n);
+        objects.vz.assign(vz, vz + n);
+    }
+    return init(settings, objects);
+}
+
+// Check the settings, allocate the buffers and merge the objects that collide at the start
+std::string Simulation::start() {
+    if (config.size_enclosure < 0) {
+        return "Invalid box size";
+    }
+    if (config.time_step < 0) {
+        return "Invalid time increment";
+    }
+    if (config.cutoff < 0) {
+        return "Invalid cutoff radius";
+    }
+    if (config.streamBlock == 0) {
+        return "Invalid stream block size";
+    }
+    if (config.threads < 0) {
+        return "Invalid number of threads";
+    }
+    if (config.deterministicChunks == 0) {
+        return "Invalid number of deterministic chunks";
+    }
+    initialSize = object.size;
+    stepCount = 0;
+    forceBuffers.clear();
+    sweptReady = false;
+    previous.assign(config.en_swept ? 3 * object.size : 0, 0);
+
+    // Room for one collision per object, the collision check only allocates in steps with more
+    toRemove.reserve(object.size);
+
+    prepareThreads();
+    checkCollisions();
+    sweptReady = config.en_swept;
+    return "";
+}
+
+ObjectsView Simulation::objects() const {
+    ObjectsView view;
+    view.size = object.size;
+    view.mass = object.mass.data();
+    view.x = object.x.data();
+    view.y = object.y.data();
+    view.z = object.z.data();
+    view.vx = object.vx.data();
+    view.vy = object.vy.data();
+    view.vz = object.vz.data();
+    if (!config.en_lean) {
+        view.fx = object.fx.data();
+        view.fy = object.fy.data();
+        view.fz = object.fz.data();
+    }
+    return view;
+}
+
+void Simulation::setThreads(const int threads) {
+    config.threads = std::max(threads, 0);
+}
+
+int Simulation::threads() const {
+    return config.threads > 0 ? config.threads : omp_get_max_threads();
+}
+
+// Allocate the force buffer (by the thread itself, not needed by the streamed kernel) and stopwatch of every thread
+// of the team (the number of objects only decreases). With en_deterministic there is also a buffer per chunk
+void Simulation::prepareThreads() {
+    const int team = threads();
+    if ((int)stats.forceThreads.size() < team) {
+        stats.forceThreads.resize(team);
+        stats.collisionThreads.resize(team);
+        stats.syncThreads.resize(team);
+    }
+    const size_t buffers = config.en_deterministic ? std::max((size_t)team, config.deterministicChunks) : team;
+    if (forceBuffers.size() < buffers) {
+        forceBuffers.resize(buffers);
+        if (!streamedForces() && !config.en_lean) {
+            #pragma omp parallel for schedule(static) num_threads(team)
+            for (int b = 0; b < (int)buffers; b++) {
+                forceBuffers[b].assign(3 * object.size, 0);
+            }
+        }
+    }
+
+    // Fork/join cost of the full team, the phases use fewer threads when the work left doesn't pay for it
+    if (adaptive() && stats.updateObjTeam.threads() != team) {
+        stats.updateObjTeam.calibrate(team);
+        stats.collisionTeam.calibrate(team);
+    }
+}
+
+// The persistent time loop keeps one team for all phases
+bool Simulation::adaptive() const {
+    return config.en_adaptive && !config.en_persistent;
+}
+
+// Threads of the next run of a phase with the given units of work (pairs or objects), all of them without en_adaptive
+int Simulation::phaseThreads(AdaptiveThreads& phase, const double units) {
+    return adaptive() ? phase.begin(units) : threads();
+}
+
+// True if objects i and j are closer than 1 at the end of the step, or with en_swept at any moment of the step
+bool Simulation::collides(const size_t i, const size_t j) {
+    if (dst_sqr(&object, i, j) < 1) {
+        return true;
+    }
+    if (!sweptReady) {
+        return false;
+    }
+    const size_t n = object.size;
+    const double* px = previous.data();
+    const double* py = px + n;
+    const double* pz = py + n;
+    return sweptCollision(px[i] - px[j], py[i] - py[j], pz[i] - pz[j],
+                          (object.x[i] - px[i]) - (object.x[j] - px[j]),
+                          (object.y[i] - py[i]) - (object.y[j] - py[j]),
+                          (object.z[i] - pz[i]) - (object.z[j] - pz[j]), 1);
+}
+
+// Finds the collisions between object i and objects 0 to i - 1 (run by every thread of the team)
+void Simulation::findCollisions() {
+    Object& objects = object;
+    if (config.en_sap) {
+        // Only check the pairs that overlap along the x axis (with en_swept over the whole path of the step)
+        const double* px = previous.data();
+        #pragma omp single
+        sweep.update(objects.size,
+            [&](size_t i) { return sweptReady ? std::min(px[i], objects.x[i]) : objects.x[i]; },
+            [&](size_t i) { return (sweptReady ? std::max(px[i], objects.x[i]) : objects.x[i]) + 1; });
+        sweep.findPairs([&](size_t i, size_t j) {
+            if (collides(i, j)) {
+                #pragma omp critical
+                toRemove.emplace_back(i, j);
+            }
+        });
+    } else {
+        // Every thread gets a block of rows with the same number of pairs
+        const int tid = omp_get_thread_num();
+        const int threads = omp_get_num_threads();
+        const int rowBegin = (int)lowerTriangleRow(objects.size, tid, threads);
+        const int rowEnd = (int)lowerTriangleRow(objects.size, tid + 1, threads);
+
+        stats.collisionThreads[tid].start();
+        for (int i = rowBegin; i < rowEnd; i++) {
+            for (int j = i - 1; j >= 0; j--) {
+                if (collides(i, j)) {
+                    #pragma omp critical
+                    toRemove.emplace_back(i, j);
+                }
+            }
+        }
+        stats.collisionThreads[tid].stop();
+    }
+}
+
+// Merges the collided objects and removes the merged ones (run by a single thread)
+void Simulation::mergeCollisions() {
+    Object& objects = object;
+
+    // Sort the pairs as if they were executed in sequential order (i first then j)
+    const size_t n = initialSize;
+    std::sort(toRemove.begin(), toRemove.end(), [n](const Pair& p1, const Pair& p2) {
+        return (p1.j - p1.i * n) < (p2.j - p2.i * n);
+    });
+    bool needRemoval = !toRemove.empty();
+    while (!toRemove.empty()) {
+        // Retrieve & remove the last element
+        auto i = toRemove.back().i;
+        auto j = toRemove.back().j;
+        toRemove.pop_back();
+
+        if (objects.removeFlag[j]) {
+            continue;
+        }
+        objects.removeFlag[j] = true;
+
+        objects.mass[i] += objects.mass[j];
+        objects.vx[i] += objects.vx[j];
+        objects.vy[i] += objects.vy[j];
+        objects.vz[i] += objects.vz[j];
+    }
+
+    // Remove elements (only if something has merged)
+    if (needRemoval) {
+        if (config.en_sap) {
+            sweep.remove([&](size_t i) { return objects.removeFlag[i]; });
+        }
+        for (size_t i = 0; i < objects.size; i++) {
+            if (objects.removeFlag[i]) {
+                if (removed) {
+                    removed(i);
+                }
+                objects.delete_object(i--);
+            }
+        }
+    }
+}
+
+// Checks for collisions between object i and objects 0 to i - 1
+void Simulation::checkCollisions() {
+    stats.collision.start();
+    stats.collisionAllocs.start();
+
+    // The team follows the pairs left (the objects with en_sap)
+    const double n = (double)object.size;
+    #pragma omp parallel num_threads(phaseThreads(stats.collisionTeam, config.en_sap ? n : n * (n - 1) / 2))
+    findCollisions();
+    if (adaptive()) {
+        stats.collisionTeam.end();
+    }
+
+    // All collisions have been detected, now merge the collided objects
+    mergeCollisions();
+
+    stats.collision.stop();
+    stats.collisionAllocs.stop();
+}
+
+// Calculate the force between the pairs of objects closer than the cutoff radius, using the cell lists
+// to only visit nearby objects (run by every thread of the team)
+void Simulation::computeCutoffForces() {
+    Object& objects = object;
+    const size_t n = objects.size;
+    const double cutoff = config.cutoff;
+    const double cutoffSqr = sqr(cutoff);
+
+    #pragma omp single
+    cells.build(n, config.size_enclosure, cutoff,
+        [&](size_t i) { return objects.x[i]; },
+        [&](size_t i) { return objects.y[i]; },
+        [&](size_t i) { return objects.z[i]; });
+
+    // Every object sums its own force (both objects of a pair compute it), so the threads can
+    // write straight into their part of their own buffer, or into the velocity with en_lean
+    const int tid = omp_get_thread_num();
+    double* buffer = forceBuffers[tid].data();
+    uint64_t interactions = 0;
+
+    stats.forceThreads[tid].start();
+    #pragma omp for schedule(static) nowait
+    for (int i = 0; i < (int)n; i++) {
+        double fx = 0;
+        double fy = 0;
+        double fz = 0;
+        cells.forNeighbours(objects.x[i], objects.y[i], objects.z[i], [&](size_t j) {
+            double dstSqr = dst_sqr(&objects, i, j);
+            if (dstSqr >= cutoffSqr || j == (size_t)i) {
+                return;
+            }
+            double dstCube = cube(std::sqrt(dstSqr));
+            double massGravDist = objects.mass[i] * objects.mass[j] * G / dstCube;
+            if (config.en_smooth) {
+                // Let the force go to zero at the cutoff radius instead of dropping off
+                massGravDist *= sqr(1 - dstSqr / cutoffSqr);
+            }
+            fx += massGravDist * (objects.x[j] - objects.x[i]);
+            fy += massGravDist * (objects.y[j] - objects.y[i]);
+            fz += massGravDist * (objects.z[j] - objects.z[i]);
+            interactions++;
+        });
+        if (config.en_lean) {
+            objects.vx[i] += fx / objects.mass[i] * config.time_step;
+            objects.vy[i] += fy / objects.mass[i] * config.time_step;
+            objects.vz[i] += fz / objects.mass[i] * config.time_step;
+        } else {
+            buffer[i] += fx;
+            buffer[n + i] += fy;
+            buffer[2 * n + i] += fz;
+        }
+    }
+    stats.forceThreads[tid].stop();
+
+    #pragma omp atomic
+    stats.cutoffInteractions += interactions;
+}
+
+// The streamed kernel writes the forces straight into the objects instead of the thread buffers
+bool Simulation::streamedForces() const {
+    return config.en_stream && config.cutoff == 0;
+}
+
+// Calculate the force between all pairs of objects without force arrays (en_lean): every object sums its own
+// force in registers, one block of objects j at a time as in the streamed kernel (same results), and applies it
+// to its velocity right away. The velocities aren't read until all forces are computed (run by every thread of
+// the team)
+void Simulation::computeLeanForces() {
+    Object& objects = object;
+    const size_t n = objects.size;
+    const size_t streamBlock = config.streamBlock;
+    const double time_step = config.time_step;
+    const int tid = omp_get_thread_num();
+
+    stats.forceThreads[tid].start();
+    #pragma omp for schedule(static) nowait
+    for (int i = 0; i < (int)n; i++) {
+        double fxi = 0;
+        double fyi = 0;
+        double fzi = 0;
+        for (size_t blockBegin = 0; blockBegin < n; blockBegin += streamBlock) {
+            const size_t blockEnd = std::min(n, blockBegin + streamBlock);
+            double fx = 0;
+            double fy = 0;
+            double fz = 0;
+            for (size_t j = blockBegin; j < blockEnd; j++) {
+                if (j == (size_t)i) {
+                    continue;
+                }
+                double massGravDist = objects.mass[i] * objects.mass[j] * G / dst_cube(&objects, i, j);
+                fx += massGravDist * (objects.x[j] - objects.x[i]);
+                fy += massGravDist * (objects.y[j] - objects.y[i]);
+                fz += massGravDist * (objects.z[j] - objects.z[i]);
+            }
+            fxi += fx;
+            fyi += fy;
+            fzi += fz;
+        }
+        objects.vx[i] += fxi / objects.mass[i] * time_step;
+        objects.vy[i] += fyi / objects.mass[i] * time_step;
+        objects.vz[i] += fzi / objects.mass[i] * time_step;
+    }
+    stats.forceThreads[tid].stop();
+}
+
+// Calculate the force between all pairs of objects for arrays that don't fit in memory: every object
+// sums its own force, with the objects j streamed one block at a time. All threads work on the same
+// block while the OS is asked to read the next one (run by every thread of the team)
+void Simulation::computeStreamedForces() {
+    Object& objects = object;
+    const size_t n = objects.size;
+    const size_t streamBlock = config.streamBlock;
+    const int tid = omp_get_thread_num();
+
+    #pragma omp for schedule(static) nowait
+    for (int i = 0; i < (int)n; i++) {
+        objects.fx[i] = objects.fy[i] = objects.fz[i] = 0;
+    }
+
+    stats.forceThreads[tid].start();
+    for (size_t blockBegin = 0; blockBegin < n; blockBegin += streamBlock) {
+        const size_t blockEnd = std::min(n, blockBegin + streamBlock);
+
+        #pragma omp single nowait
+        {
+            const size_t bytes = (std::min(n, blockEnd + streamBlock) - blockEnd) * sizeof(double);
+            adviseWillNeed(objects.x.data() + blockEnd, bytes);
+            adviseWillNeed(objects.y.data() + blockEnd, bytes);
+            adviseWillNeed(objects.z.data() + blockEnd, bytes);
+            adviseWillNeed(objects.mass.data() + blockEnd, bytes);
+        }
+
+        // Same static partition for every block, the implicit barrier keeps the threads on the same block
+        #pragma omp for schedule(static)
+        for (int i = 0; i < (int)n; i++) {
+            double fx = 0;
+            double fy = 0;
+            double fz = 0;
+            for (size_t j = blockBegin; j < blockEnd; j++) {
+                if (j == (size_t)i) {
+                    continue;
+                }
+                double massGravDist = objects.mass[i] * objects.mass[j] * G / dst_cube(&objects, i, j);
+                fx += massGravDist * (objects.x[j] - objects.x[i]);
+                fy += massGravDist * (objects.y[j] - objects.y[i]);
+                fz += massGravDist * (objects.z[j] - objects.z[i]);
+            }
+            objects.fx[i] += fx;
+            objects.fy[i] += fy;
+            objects.fz[i] += fz;
+        }
+    }
+    stats.forceThreads[tid].stop();
+    stats.syncThreads[tid].start();
+    #pragma omp barrier
+    stats.syncThreads[tid].stop();
+}
+
+// Add the forces of the pairs of the rows [rowBegin, rowEnd) to buffer (the pairs of a row also change the
+// force on the objects j > i)
+void Simulation::addPairForces(const size_t rowBegin, const size_t rowEnd, double* buffer) {
+    Object& objects = object;
+    const size_t n = objects.size;
+    double* bx = buffer;
+    double* by = bx + n;
+    double* bz = by + n;
+    for (size_t i = rowBegin; i < rowEnd; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            double massGravDist = objects.mass[i] * objects.mass[j] * G / dst_cube(&objects, i, j);
+            double fx = massGravDist * (objects.x[j] - objects.x[i]);
+            double fy = massGravDist * (objects.y[j] - objects.y[i]);
+            double fz = massGravDist * (objects.z[j] - objects.z[i]);
+
+            bx[i] += fx;
+            bx[j] -= fx;
+            by[i] += fy;
+            by[j] -= fy;
+            bz[i] += fz;
+            bz[j] -= fz;
+        }
+    }
+}
+
+// Calculate the force between all pairs of objects (run by every thread of the team)
+void Simulation::computeForces() {
+    if (config.cutoff > 0) {
+        computeCutoffForces();
+        return;
+    }
+    if (config.en_lean) {
+        computeLeanForces();
+        return;
+    }
+    if (config.en_stream) {
+        computeStreamedForces();
+        return;
+    }
+    const size_t n = object.size;
+    const int tid = omp_get_thread_num();
+    const int threads = omp_get_num_threads();
+
+    stats.forceThreads[tid].start();
+    if (config.en_deterministic) {
+        // A fixed number of chunks with the same number of pairs, each with its own buffer, whichever thread
+        // computes it. The buffers are summed in chunk order, so the forces don't depend on the threads
+        const size_t chunks = config.deterministicChunks;
+        #pragma omp for schedule(dynamic) nowait
+        for (int c = 0; c < (int)chunks; c++) {
+            addPairForces(upperTriangleRow(n, c, chunks), upperTriangleRow(n, c + 1, chunks), forceBuffers[c].data());
+        }
+    } else {
+        // Every thread gets a block of rows with the same number of pairs, and adds the forces to its own buffer
+        addPairForces(upperTriangleRow(n, tid, threads), upperTriangleRow(n, tid + 1, threads), forceBuffers[tid].data());
+    }
+    stats.forceThreads[tid].stop();
+}
+
+// Calculate the change in velocity and position of every object (run by every thread of the team,
+// after all forces are computed)
+void Simulation::moveObjects() {
+    Object& objects = object;
+    const size_t n = objects.size;
+    const int tid = omp_get_thread_num();
+    const int threads = omp_get_num_threads();
+    const size_t begin = evenRow(n, tid, threads);
+    const size_t end = evenRow(n, tid + 1, threads);
+
+    // Sum the buffers of all threads, or of all chunks (and threads with cutoff=R) in order with en_deterministic
+    // (and clear them for the next step)
+    const int buffers = config.en_deterministic ? (int)forceBuffers.size() : threads;
+    if (!streamedForces() && !config.en_lean) {
+        for (size_t i = begin; i < end; i++) {
+            objects.fx[i] = objects.fy[i] = objects.fz[i] = 0;
+            for (int t = 0; t < buffers; t++) {
+                double* buffer = forceBuffers[t].data();
+                objects.fx[i] += buffer[i];
+                objects.fy[i] += buffer[n + i];
+                objects.fz[i] += buffer[2 * n + i];
+                buffer[i] = buffer[n + i] = buffer[2 * n + i] = 0;
+            }
+        }
+    }
+    if (config.en_swept) {
+        std::copy(objects.x.begin() + begin, objects.x.begin() + end, previous.begin() + begin);
+        std::copy(objects.y.begin() + begin, objects.y.begin() + end, previous.begin() + n + begin);
+        std::copy(objects.z.begin() + begin, objects.z.begin() + end, previous.begin() + 2 * n + begin);
+    }
+
+    // With en_lean the velocities are already updated, only the position and boundary bounce are left
+    if (config.en_lean) {
+        moveAxis(begin, end, objects.vx.data(), objects.x.data(), config.time_step, config.size_enclosure);
+        moveAxis(begin, end, objects.vy.data(), objects.y.data(), config.time_step, config.size_enclosure);
+        moveAxis(begin, end, objects.vz.data(), objects.z.data(), config.time_step, config.size_enclosure);
+        return;
+    }
+
+    // Velocity, position and boundary bounce of the same objects, one branchless pass per axis
+    integrateAxis(begin, end, objects.mass.data(), objects.fx.data(), objects.vx.data(), objects.x.data(), config.time_step, config.size_enclosure);
+    integrateAxis(begin, end, objects.mass.data(), objects.fy.data(), objects.vy.data(), objects.y.data(), config.time_step, config.size_enclosure);
+    integrateAxis(begin, end, objects.mass.data(), objects.fz.data(), objects.vz.data(), objects.z.data(), config.time_step, config.size_enclosure);
+}
+
+// Calculate the force, change in velocity and position of every object
+void Simulation::updateObjects() {
+    stats.updateObj.start();
+    stats.updateObjAllocs.start();
+
+    // The team follows the pairs left (the objects with cutoff=R)
+    const double n = (double)object.size;
+    #pragma omp parallel num_threads(phaseThreads(stats.updateObjTeam, config.cutoff > 0 ? n : n * (n - 1) / 2 + n))
+    {
+        computeForces();
+
+        // Wait until all forces are computed, all positions are still the ones of the previous step
+        #pragma omp barrier
+
+        moveObjects();
+    }
+    if (adaptive()) {
+        stats.updateObjTeam.end();
+    }
+    stats.updateObj.stop();
+    stats.updateObjAllocs.stop();
+}
+
+// Barrier between two phases of the persistent time loop, the waiting time is the synchronization cost
+void Simulation::phaseBarrier() {
+    const int tid = omp_get_thread_num();
+    stats.syncThreads[tid].start();
+    #pragma omp barrier
+    stats.syncThreads[tid].stop();
+}
+
+// Time loop with one fork/join for all n steps, the same team of threads runs every phase
+void Simulation::runPersistent(const size_t n) {
+    #pragma omp parallel num_threads(threads())
+    {
+        for (size_t iteration = 0; iteration < n; iteration++) {
+            #pragma omp master
+            {
+                if (beforeStep) {
+                    beforeStep(stepCount + 1);
+                }
+                stats.updateObj.start();
+                stats.updateObjAllocs.start();
+            }
+
+            computeForces();
+            phaseBarrier();
+            moveObjects();
+            phaseBarrier();
+
+            #pragma omp master
+            {
+                stats.updateObj.stop();
+                stats.updateObjAllocs.stop();
+                stats.collision.start();
+                stats.collisionAllocs.start();
+            }
+
+            findCollisions();
+            phaseBarrier();
+
+            // All collisions have been detected, now merge the collided objects
+            #pragma omp master
+            {
+                mergeCollisions();
+                stats.collision.stop();
+                stats.collisionAllocs.stop();
+                stepCount++;
+                if (afterStep) {
+                    afterStep(stepCount);
+                }
+            }
+            phaseBarrier();
+        }
+    }
+}
+
+void Simulation::step(const size_t n) {
+    prepareThreads();
+    if (config.en_persistent) {
+        runPersistent(n);
+        return;
+    }
+    for (size_t iteration = 0; iteration < n; iteration++) {
+        if (beforeStep) {
+            beforeStep(stepCount + 1);
+        }
+
+        updateObjects();
+
+        checkCollisions();
+
+        stepCount++;
+        if (afterStep) {
+            afterStep(stepCount);
+        }
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "object.h"
+#include "../common/adaptive.h"
+#include "../common/allocs.h"
+#include "../common/cells.h"
+#include "../common/config_io.h"
+#include "../common/pair.h"
+#include "../common/sweep.h"
+#include "../common/swept.h"
+#include "../common/watch.h"
+
+// Settings of a simulation: the enclosure and time step of the positional arguments and the options of sim-psoa.
+// The NUMA and storage settings are process wide (numaSettings, storageSettings)
+struct SimulationSettings {
+    double size_enclosure = 0;
+    double time_step = 0;
+    bool en_sap = false;
+    bool en_persistent = false;
+    bool en_swept = false;          // Also merge the objects whose paths come closer than 1 during the step
+    bool en_deterministic = false;  // Same results for any number of threads
+    size_t deterministicChunks = 64; // Fixed chunks of the force rows with en_deterministic
+    bool en_adaptive = false;       // Fewer threads in a phase when the objects left don't pay for them (not with en_persistent)
+    bool en_lean = false;           // No force arrays or buffers, the forces go straight into the velocities
+    double cutoff = 0;              // Only compute the forces between objects closer than this (0: all pairs)
+    bool en_smooth = false;
+    bool en_stream = false;         // Streamed force kernel (always used with storage=dir)
+    size_t streamBlock = 262144;    // Objects per block of the streamed kernel
+    int threads = 0;                // OpenMP threads of the steps (0: the OpenMP default)
+};
+
+// Read-only view of the objects, no copy: the pointers are valid until the next step
+struct ObjectsView {
+    size_t size = 0;
+    const double* mass = nullptr;
+    const double* x = nullptr;
+    const double* y = nullptr;
+    const double* z = nullptr;
+    const double* vx = nullptr;
+    const double* vy = nullptr;
+    const double* vz = nullptr;
+    const double* fx = nullptr;     // Forces of the last step (null with en_lean)
+    const double* fy = nullptr;
+    const double* fz = nullptr;
+};
+
+// Time and allocations of the phases of all steps so far
+struct SimulationStatistics {
+    watch updateObj, collision;
+    allocWatch updateObjAllocs, collisionAllocs;
+
+    // Per thread time spent in the force and collision pair loops, and waiting in the barriers of en_persistent
+    std::vector<watch> forceThreads, collisionThreads, syncThreads;
+
+    // Team size of the update and collision phases with en_adaptive
+    AdaptiveThreads updateObjTeam, collisionTeam;
+
+    // Interactions computed within the cutoff radius (both objects of a pair count)
+    uint64_t cutoffInteractions = 0;
+};
+
+// The sim-psoa engine as a library: create it with init, then run steps. Objects that collide are merged
+// after every step, also once in init
+class Simulation {
+public:
+    // Called by one thread before and after every step, with the number of the step (1 for the first one)
+    std::function<void(size_t)> beforeStep, afterStep;
+
+    // Called for every merged object that is removed, with its index at that moment (the later objects shift down)
+    std::function<void(size_t)> removed;
+
+    SimulationStatistics stats;
+
+    // Generated objects (std::mt19937_64, or Philox with en_philox). Returns an error message, empty on success
+    std::string init(const SimulationSettings& settings, size_t num_objects, uint64_t seed, bool en_philox = false);
+    // The objects of a config file
+    std::string init(const SimulationSettings& settings, const Config& config);
+    // n objects from arrays (copied), velocities may be null for objects at rest
+    std::string init(const SimulationSettings& settings, size_t n, const double* mass, const double* x, const double* y, const double* z,
+                     const double* vx = nullptr, const double* vy = nullptr, const double* vz = nullptr);
+
+    // Run n steps
+    void step(size_t n = 1);
+
+    ObjectsView objects() const;
+    size_t size() const {
+        return object.size;
+    }
+    size_t steps() const {
+        return stepCount;
+    }
+    const SimulationSettings& settings() const {
+        return config;
+    }
+
+    // Threads of the next steps (0: the OpenMP default)
+    void setThreads(int threads);
+    int threads() const;
+
+private:
+    SimulationSettings config;
+    Object object;
+    size_t initialSize = 0;
+    size_t stepCount = 0;
+
+    // Per thread force buffers (x, y and z block of the size of the objects), per chunk with en_deterministic
+    std::vector<std::vector<double>> forceBuffers;
+
+    // Broad phase for the collision check (only used with en_sap)
+    SweepAndPrune sweep;
+
+    // Positions at the start of the step (x, y and z block, only used with en_swept), the check in init only
+    // uses the current positions
+    std::vector<double> previous;
+    bool sweptReady = false;
+
+    // Cells for the forces with a cutoff radius
+    CellList cells;
+
+    // Collisions found in the current step, sorted in sequential order before they are merged. A vector
+    // instead of a set, so the collision check doesn't allocate once the capacity has grown
+    std::vector<Pair> toRemove;
+
+    std::string start();
+    void prepareThreads();
+    bool adaptive() const;
+    int phaseThreads(AdaptiveThreads& phase, double units);
+    bool streamedForces() const;
+    bool collides(size_t i, size_t j);
+    void findCollisions();
+    void mergeCollisions();
+    void checkCollisions();
+    void computeCutoffForces();
+    void computeStreamedForces();
+    void computeLeanForces();
+    void addPairForces(size_t rowBegin, size_t rowEnd, double* buffer);
+    void computeForces();
+    void moveObjects();
+    void updateObjects();
+    void phaseBarrier();
+    void runPersistent(size_t n);
+};
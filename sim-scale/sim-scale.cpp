@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/launch.h"
+#include "../common/options.h"
+
+// Options of sim-scale itself, all other optional arguments are passed on to the engines
+const char* scaleOptions[] = { "engines", "modes", "num_objects", "num_iterations", "random_seed", "size_enclosure", "time_step",
+                               "max_threads", "samples", "csv" };
+
+// Time of one engine run, split in the phases the parallel engines print (0 if the engine doesn't print them)
+struct Timing {
+    int exitCode = 0;
+    double totalMs = 0;
+    double updateMs = 0;
+    double collisionMs = 0;
+    double syncUs = 0;
+};
+
+// One line of the table
+struct Result {
+    std::string engine;
+    std::string mode;
+    int threads = 1;
+    int objects = 0;
+    Timing timing;
+};
+
+std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+// Runs the engine in the current directory and reads the times of its summary
+Timing runEngine(const std::string& command) {
+    Timing timing;
+    std::string output;
+    timing.exitCode = runCapture(command, &output);
+    std::stringstream lines(output);
+    std::string line;
+    while (std::getline(lines, line)) {
+        // "Total execution time: T ms: UpdateObjTime U ms (..), CollisionTime C ms" of the parallel engines,
+        // "Total execution time was T ms." of the serial ones
+        double total, update, updateRel, collision;
+        if (std::sscanf(line.c_str(), "Total execution time: %lfms: UpdateObjTime %lfms (%lf%%), CollisionTime %lfms", &total, &update, &updateRel, &collision) == 4) {
+            timing.totalMs = total;
+            timing.updateMs = update;
+            timing.collisionMs = collision;
+        } else if (std::sscanf(line.c_str(), "Total execution time was %lf ms", &total) == 1) {
+            timing.totalMs = total;
+        }
+        std::sscanf(line.c_str(), "Synchronization per step: %lfus", &timing.syncUs);
+    }
+    return timing;
+}
+
+// Efficiency of a phase relative to the single thread run: 1 when the time drops with the threads (strong)
+// or stays the same (weak). 0 if the phase isn't measured
+double efficiency(const std::string& mode, const double base, const double time, const int threads) {
+    if (base <= 0 || time <= 0) {
+        return 0;
+    }
+    return mode == "strong" ? base / (time * threads) : base / time;
+}
+
+// Strong scaling (the same system for 1 to max_threads threads) and weak scaling (the work of a step grows
+// with the threads) of the parallel engines, with the time of every phase and the parallel efficiency
+int main(int argc, char** argv) {
+    Options options(argc, argv, 1);
+    const int num_objects = std::stoi(options.get("num_objects", "2000"));
+    const int num_iterations = std::stoi(options.get("num_iterations", "10"));
+    const std::string seed = options.get("random_seed", "31728674");
+    const std::string size_enclosure = options.get("size_enclosure", "1000000");
+    const std::string time_step = options.get("time_step", "0.01");
+    const int maxThreads = std::stoi(options.get("max_threads", std::to_string(std::max(1u, std::thread::hardware_concurrency()))));
+    const int samples = std::stoi(options.get("samples", "3"));
+    if (num_objects < 1) {
+        std::cerr << "Error: Invalid number of objects\n";
+        return -2;
+    }
+    if (num_iterations < 1) {
+        std::cerr << "Error: Invalid number of iterations\n";
+        return -2;
+    }
+    if (maxThreads < 1) {
+        std::cerr << "Error: Invalid number of threads\n";
+        return -2;
+    }
+    if (samples < 1) {
+        std::cerr << "Error: Invalid number of samples\n";
+        return -2;
+    }
+    const std::vector<std::string> modes = split(options.get("modes", "strong,weak"));
+    for (const std::string& mode : modes) {
+        if (mode != "strong" && mode != "weak") {
+            std::cerr << "Error: Unknown mode " << mode << "\n";
+            return -1;
+        }
+    }
+
+    // Engine options, the paths are made absolute as the engines run in another directory
+    std::vector<std::string> engineArgs;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const std::string name = arg.substr(0, arg.find('='));
+        if (std::find_if(std::begin(scaleOptions), std::end(scaleOptions), [&](const char* option) { return name == option; }) != std::end(scaleOptions)) {
+            continue;
+        }
+        if (name == "init" || name == "storage") {
+            engineArgs.push_back(name + "=" + std::filesystem::absolute(options.get(name)).string());
+        } else {
+            engineArgs.push_back(arg);
+        }
+    }
+
+    // 1, 2, 4, ... threads up to max_threads
+    std::vector<int> threadCounts;
+    for (int threads = 1; ; threads = std::min(2 * threads, maxThreads)) {
+        threadCounts.push_back(threads);
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+
+    // The engines are next to sim-scale, and write their files in a directory of their own
+    const std::filesystem::path directory = std::filesystem::absolute(argv[0]).parent_path();
+    const std::string csvPath = options.has("csv") ? std::filesystem::absolute(options.get("csv")).string() : "";
+    const std::filesystem::path workDirectory = std::filesystem::current_path();
+    const std::filesystem::path scaleDirectory = std::filesystem::temp_directory_path() / ("sim-scale-" + std::to_string(std::hash<std::string>()(workDirectory.string())));
+    std::filesystem::create_directories(scaleDirectory);
+    std::filesystem::current_path(scaleDirectory);
+
+    std::vector<Result> results;
+    int failures = 0;
+    for (const std::string& engine : split(options.get("engines", "paos,psoa"))) {
+        if (!std::filesystem::exists(engineExecutable(directory, engine))) {
+            std::cerr << "Error: sim-" << engine << " not found\n";
+            failures++;
+            continue;
+        }
+        for (const std::string& mode : modes) {
+            std::printf("sim-%s, %s scaling\n", engine.c_str(), mode.c_str());
+            std::printf("  %7s %8s %10s %10s %10s %10s %10s %8s %8s %8s %8s\n", "threads", "objects", "total ms", "update ms", "collide ms",
+                        "other ms", "sync us", "speedup", "eff", "upd eff", "col eff");
+            // The single thread run of this engine and mode is the base of the speedup
+            const size_t first = results.size();
+            for (const int threads : threadCounts) {
+                // The pair loops are O(N^2), so N grows with the square root of the threads for the same work per thread
+                Result result;
+                result.engine = engine;
+                result.mode = mode;
+                result.threads = threads;
+                result.objects = mode == "strong" ? num_objects : (int)std::lround(num_objects * std::sqrt((double)threads));
+
+                std::string command = quote(engineExecutable(directory, engine).string());
+                command.append(" ").append(std::to_string(result.objects)).append(" ").append(std::to_string(num_iterations));
+                command.append(" ").append(seed).append(" ").append(size_enclosure).append(" ").append(time_step);
+                for (const std::string& arg : engineArgs) {
+                    command.append(" ").append(quote(arg));
+                }
+                setThreads(threads);
+
+                // The fastest of the samples
+                for (int sample = 0; sample < samples; sample++) {
+                    const Timing timing = runEngine(command);
+                    if (timing.exitCode != 0) {
+                        result.timing = timing;
+                        break;
+                    }
+                    if (sample == 0 || timing.totalMs < result.timing.totalMs) {
+                        result.timing = timing;
+                    }
+                }
+                if (result.timing.exitCode != 0) {
+                    std::printf("  %7d %8d FAIL (exit code %d)\n", threads, result.objects, result.timing.exitCode);
+                    failures++;
+                    break;
+                }
+                results.push_back(result);
+
+                const Timing& t = result.timing;
+                const Timing& b = results[first].timing;
+                const double otherMs = t.updateMs > 0 ? t.totalMs - t.updateMs - t.collisionMs : 0;
+                std::printf("  %7d %8d %10.1f %10.1f %10.1f %10.1f %10.1f %8.2f %8.2f %8.2f %8.2f\n", threads, result.objects, t.totalMs,
+                            t.updateMs, t.collisionMs, otherMs, t.syncUs, b.totalMs / t.totalMs * (mode == "weak" ? threads : 1),
+                            efficiency(mode, b.totalMs, t.totalMs, threads), efficiency(mode, b.updateMs, t.updateMs, threads),
+                            efficiency(mode, b.collisionMs, t.collisionMs, threads));
+            }
+        }
+    }
+    std::filesystem::current_path(workDirectory);
+    std::filesystem::remove_all(scaleDirectory);
+
+    if (!csvPath.empty()) {
+        std::ofstream csv(csvPath);
+        csv << "engine,mode,threads,num_objects,total_ms,update_ms,collision_ms,sync_us\n";
+        for (const Result& result : results) {
+            csv << result.engine << "," << result.mode << "," << result.threads << "," << result.objects << "," << result.timing.totalMs << ","
+                << result.timing.updateMs << "," << result.timing.collisionMs << "," << result.timing.syncUs << "\n";
+        }
+        if (!csv) {
+            std::cerr << "Error: Can't write " << csvPath << "\n";
+            return -3;
+        }
+    }
+    return failures > 0 ? -2 : 0;
+}
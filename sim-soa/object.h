@@ -3,6 +3,10 @@
 #include <cmath>
 #include <vector>
 
+#include "../common/config_io.h"
+#include "../common/integrate.h"
+#include "../common/philox.h"
+
 #define sqr(a) (a)*(a)
 #define cube(a) (a)*(a)*(a)
 
@@ -29,7 +33,7 @@ struct Object {
 	std::vector <double> fz;
 
 	// Constructor
-	Object(const size_t size, const uint64_t seed, const double size_enclosure) : size(size),
+	Object(const size_t size, const uint64_t seed, const double size_enclosure, const bool en_philox = false) : size(size),
 		mass(size),
 		x(size),
 		y(size),
@@ -41,6 +45,15 @@ struct Object {
 		fy(size),
 		fz(size)
 	{
+		if (en_philox) {
+			// Every object only depends on (seed, i), so they can be generated in any order
+			Philox rng(seed);
+			for (int i = 0; i < (int)size; ++i) {
+				philoxObject(rng, i, size_enclosure, x[i], y[i], z[i], mass[i]);
+			}
+			return;
+		}
+
 		// Initialize the RNG
 		std::mt19937_64 gen(seed);
 		std::uniform_real_distribution<> uniform_distr(0, size_enclosure);
@@ -55,6 +68,21 @@ struct Object {
 		}
 	}
 
+	// Constructor from the objects of a config file
+	Object(const Config& config) : size(config.size()),
+		mass(config.mass.begin(), config.mass.end()),
+		x(config.x.begin(), config.x.end()),
+		y(config.y.begin(), config.y.end()),
+		z(config.z.begin(), config.z.end()),
+		vx(config.vx.begin(), config.vx.end()),
+		vy(config.vy.begin(), config.vy.end()),
+		vz(config.vz.begin(), config.vz.end()),
+		fx(size),
+		fy(size),
+		fz(size)
+	{
+	}
+
 	// Reset the forces to zero
 	inline void reset_forces() {
 		std::fill(fx.begin(), fx.end(), 0);
@@ -62,32 +90,11 @@ struct Object {
 		std::fill(fz.begin(), fz.end(), 0);
 	}
 
-	// Keep objects inside the boundary
+	// Keep objects inside the boundary (branchless)
 	inline void adjust_for_boundary(const double size_enclosure, const size_t i) {
-		if (x[i] < 0) {
-			x[i] = 0;
-			vx[i] *= -1;
-		}
-		if (x[i] > size_enclosure) {
-			x[i] = size_enclosure;
-			vx[i] *= -1;
-		}
-		if (y[i] < 0) {
-			y[i] = 0;
-			vy[i] *= -1;
-		}
-		if (y[i] > size_enclosure) {
-			y[i] = size_enclosure;
-			vy[i] *= -1;
-		}
-		if (z[i] < 0) {
-			z[i] = 0;
-			vz[i] *= -1;
-		}
-		if (z[i] > size_enclosure) {
-			z[i] = size_enclosure;
-			vz[i] *= -1;
-		}
+		reflect(x[i], vx[i], size_enclosure);
+		reflect(y[i], vy[i], size_enclosure);
+		reflect(z[i], vz[i], size_enclosure);
 	}
 
 	// j merges into i (j deleted)
@@ -114,8 +121,9 @@ struct Object {
 		size--;
 	}
 
-	// Check for possible collisions (for objects j < i)
-	inline void check_collisions(size_t& i) {
+	// Check for possible collisions (for objects j < i), removed(j) is called before object j merges into i
+	template <typename Removed>
+	inline void check_collisions(size_t& i, Removed removed) {
 		size_t iterator = 0;
 		while (iterator < i)
 		{
@@ -123,6 +131,7 @@ struct Object {
 			if (dst_sqr(this, i, iterator) < 1)
 			{
 				// Collision detected, merge iterator object into i
+				removed(iterator);
 				merge_objects(i, iterator);
 
 				// Decrement i, as i is now one index lower
@@ -8,6 +8,12 @@
 #include <chrono>
 #include <string> //needed for conversing argv
 #include "object.h"
+#include "../common/allocs.h"
+#include "../common/config_io.h"
+#include "../common/options.h"
+#include "../common/small.h"
+#include "../common/telemetry.h"
+#include "../common/trajectory.h"
 
 #define G 6.674E-11
 
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "../common/config_io.h"
+#include "../common/launch.h"
+#include "../common/options.h"
+#include "../common/telemetry.h"
+
+// Options of sim-tune itself, all other optional arguments are passed on to the engine
+const char* tuneOptions[] = { "tune_cache", "tune_steps", "tune_engines", "en_retune" };
+
+// Options that don't change which configuration is fastest (left out of the cache key and the calibration runs)
+const char* outputOptions[] = { "en_benchmark", "traj", "traj_every", "traj_bits", "traj_keyframe", "telemetry", "telemetry_every", "en_alloc_check", "en_exact_config" };
+
+// Options with a path as value, only their name is part of the cache key
+const char* pathOptions[] = { "init", "storage" };
+
+// One engine configuration
+struct Candidate {
+    std::string engine;
+    int threads = 1;
+    bool persistent = false;
+    double stepMs = 0;
+};
+
+bool inList(const std::string& name, const char* const* list, size_t count) {
+    return std::find_if(list, list + count, [&](const char* item) { return name == item; }) != list + count;
+}
+
+std::string optionName(const std::string& arg) {
+    return arg.substr(0, arg.find('='));
+}
+
+// Name of this machine and its number of hardware threads
+std::string machineName() {
+    std::string host = "unknown";
+#ifdef _WIN32
+    if (const char* name = std::getenv("COMPUTERNAME")) {
+        host = name;
+    }
+#else
+    char name[256] = {};
+    if (gethostname(name, sizeof(name) - 1) == 0) {
+        host = name;
+    }
+#endif
+    return host + "/" + std::to_string(std::thread::hardware_concurrency());
+}
+
+// Fastest step of a telemetry file (the first step is left out when there are more), 0 if there is none
+double fastestStep(const std::string& path) {
+    std::vector<std::vector<double>> lines = readTelemetry(path);
+    if (lines.size() > 1) {
+        lines.erase(lines.begin());
+    }
+    double fastest = 0;
+    for (const std::vector<double>& line : lines) {
+        if (line.size() > 7 && (fastest == 0 || line[7] < fastest)) {
+            fastest = line[7];
+        }
+    }
+    return fastest;
+}
+
+// Runs the engine with the best configuration for this input: from the cache when the (size bucket, machine,
+// options) was tuned before, otherwise a few calibration steps of every candidate pick the fastest one
+int main(int argc, char** argv) {
+    if (argc < 6) {
+        std::cerr << "Usage: sim-tune num_objects num_iterations random_seed size_enclosure time_step [options]\n";
+        return -1;
+    }
+    Options options(argc, argv, 6);
+    const bool en_benchmark = options.has("en_benchmark");
+    const int num_objects = std::stoi(argv[1]);
+    const std::string cachePath = options.get("tune_cache", "tune_cache.csv");
+    const int tuneSteps = std::stoi(options.get("tune_steps", "3"));
+    if (num_objects < 0) {
+        std::cerr << "Error: Invalid number of objects\n";
+        return -2;
+    }
+    if (tuneSteps < 1) {
+        std::cerr << "Error: Invalid number of calibration steps\n";
+        return -2;
+    }
+
+    // The engines are next to sim-tune
+    const std::filesystem::path directory = std::filesystem::absolute(argv[0]).parent_path();
+    auto executable = [&](const std::string& engine) {
+        return engineExecutable(directory, engine);
+    };
+
+    // Engine options, and the ones that can change the fastest configuration
+    std::vector<std::string> engineArgs, calibrationArgs;
+    std::string optionsKey;
+    for (int i = 6; i < argc; i++) {
+        const std::string arg = argv[i];
+        const std::string name = optionName(arg);
+        if (inList(name, tuneOptions, std::size(tuneOptions))) {
+            continue;
+        }
+        std::string engineArg = arg;
+        if (inList(name, pathOptions, std::size(pathOptions))) {
+            // The calibration runs in another directory
+            engineArg = name + "=" + std::filesystem::absolute(options.get(name)).string();
+        }
+        engineArgs.push_back(engineArg);
+        if (!inList(name, outputOptions, std::size(outputOptions))) {
+            calibrationArgs.push_back(engineArg);
+            optionsKey.append(optionsKey.empty() ? "" : " ").append(inList(name, pathOptions, std::size(pathOptions)) ? name : arg);
+        }
+    }
+
+    // Systems of similar size share a cache entry: the next power of two. With init=file the engines take the
+    // objects of the file, so its header gives the size
+    size_t objects = (size_t)num_objects;
+    if (options.has("init")) {
+        Config header;
+        const std::string error = loadConfigHeader(options.get("init"), header, objects);
+        if (!error.empty()) {
+            std::cerr << "Error: " << error << "\n";
+            return -3;
+        }
+    }
+    size_t bucket = 1;
+    while (bucket < objects) {
+        bucket *= 2;
+    }
+    const std::string machine = machineName();
+    const std::string key = machine + "," + std::to_string(bucket) + "," + optionsKey;
+
+    // Look up the cache (host,bucket,options,engine,threads,persistent,step_ms), the last matching line counts
+    Candidate best;
+    bool cached = false;
+    std::vector<std::string> cacheLines;
+    {
+        std::ifstream cache(cachePath);
+        std::string line;
+        while (std::getline(cache, line)) {
+            if (line.rfind(key + ",", 0) == 0 && std::count(line.begin() + key.size(), line.end(), ',') == 4) {
+                std::stringstream fields(line.substr(key.size() + 1));
+                std::string threads, persistent, stepMs;
+                std::getline(fields, best.engine, ',');
+                std::getline(fields, threads, ',');
+                std::getline(fields, persistent, ',');
+                std::getline(fields, stepMs, ',');
+                best.threads = std::stoi(threads);
+                best.persistent = persistent == "1";
+                best.stepMs = std::stod(stepMs);
+                cached = !options.has("en_retune");
+            }
+            cacheLines.push_back(line);
+        }
+    }
+
+    if (!cached) {
+        // Candidates: the serial engines, and the parallel ones for 1, 2, 4, ... threads with and without en_persistent
+        std::vector<std::string> engines = { "aos", "soa", "aosoa", "paos", "psoa" };
+        if (options.has("tune_engines")) {
+            engines.clear();
+            std::stringstream list(options.get("tune_engines"));
+            std::string engine;
+            while (std::getline(list, engine, ',')) {
+                engines.push_back(engine);
+            }
+        }
+        const int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<Candidate> candidates;
+        for (const std::string& engine : engines) {
+            if (!std::filesystem::exists(executable(engine))) {
+                continue;
+            }
+            if (engine[0] != 'p') {
+                candidates.push_back({ engine, 1, false });
+                continue;
+            }
+            for (int threads = 1; ; threads = std::min(2 * threads, maxThreads)) {
+                candidates.push_back({ engine, threads, false });
+                candidates.push_back({ engine, threads, true });
+                if (threads == maxThreads) {
+                    break;
+                }
+            }
+        }
+
+        // Calibration in a directory of its own, so the config files of the run aren't overwritten
+        const std::filesystem::path workDirectory = std::filesystem::current_path();
+        const std::filesystem::path calibrationDirectory = std::filesystem::temp_directory_path() / ("sim-tune-" + std::to_string(std::hash<std::string>()(workDirectory.string() + key)));
+        std::filesystem::create_directories(calibrationDirectory);
+        std::filesystem::current_path(calibrationDirectory);
+        const std::string telemetryPath = (calibrationDirectory / "calibration.csv").string();
+        best.stepMs = -1;
+        for (Candidate& candidate : candidates) {
+            std::string command = quote(executable(candidate.engine).string());
+            for (int i = 1; i < 6; i++) {
+                command.append(" ").append(i == 2 ? std::to_string(tuneSteps) : argv[i]);
+            }
+            for (const std::string& arg : calibrationArgs) {
+                command.append(" ").append(quote(arg));
+            }
+            command.append(" en_benchmark ").append(quote("telemetry=" + telemetryPath)).append(candidate.persistent ? " en_persistent" : "");
+            setThreads(candidate.threads);
+
+            // Engines that don't accept the options fail, they are no candidate
+            std::filesystem::remove(telemetryPath);
+            if (runCapture(command) != 0) {
+                continue;
+            }
+            candidate.stepMs = fastestStep(telemetryPath);
+            if (!en_benchmark) {
+                std::printf("Calibration sim-%s, %d threads%s: %.3f ms per step\n", candidate.engine.c_str(), candidate.threads,
+                            candidate.persistent ? ", persistent" : "", candidate.stepMs);
+            }
+            if (best.stepMs < 0 || candidate.stepMs < best.stepMs) {
+                best = candidate;
+            }
+        }
+        std::filesystem::current_path(workDirectory);
+        std::filesystem::remove_all(calibrationDirectory);
+        if (best.stepMs < 0) {
+            std::cerr << "Error: No engine runs with these options\n";
+            return -1;
+        }
+
+        // Replace the entry of this key in the cache
+        cacheLines.erase(std::remove_if(cacheLines.begin(), cacheLines.end(), [&](const std::string& line) {
+            return line.rfind(key + ",", 0) == 0;
+        }), cacheLines.end());
+        if (cacheLines.empty()) {
+            cacheLines.push_back("host,bucket,options,engine,threads,persistent,step_ms");
+        }
+        char stepMs[32];
+        std::snprintf(stepMs, sizeof(stepMs), "%.6f", best.stepMs);
+        cacheLines.push_back(key + "," + best.engine + "," + std::to_string(best.threads) + "," + (best.persistent ? "1" : "0") + "," + stepMs);
+        std::ofstream cache(cachePath);
+        for (const std::string& line : cacheLines) {
+            cache << line << "\n";
+        }
+        if (!cache) {
+            std::cerr << "Error: Can't write " << cachePath << "\n";
+            return -3;
+        }
+    }
+
+    // The actual run, with the output of the engine
+    if (!en_benchmark) {
+        std::printf("Running sim-%s with %d threads%s (%s, %.3f ms per step)\n", best.engine.c_str(), best.threads,
+                    best.persistent ? ", persistent" : "", cached ? "cached" : "calibrated", best.stepMs);
+        std::fflush(stdout);
+    }
+    std::string command = quote(executable(best.engine).string());
+    for (int i = 1; i < 6; i++) {
+        command.append(" ").append(argv[i]);
+    }
+    for (const std::string& arg : engineArgs) {
+        command.append(" ").append(quote(arg));
+    }
+    if (best.persistent) {
+        command += " en_persistent";
+    }
+    setThreads(best.threads);
+    std::fflush(stdout);
+    return exitCode(std::system(shellCommand(command).c_str()));
+}
@@ -0,0 +1,329 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../common/config_io.h"
+#include "../common/launch.h"
+#include "../common/options.h"
+#include "../common/telemetry.h"
+
+// All engines the build has (the sim-* targets except the tools, set by CMakeLists.txt)
+#ifndef ENGINES
+#error "ENGINES must list the engines, e.g. -DENGINES=\"aos,soa\""
+#endif
+
+// Options of sim-validate itself, all other optional arguments are passed on to the engines
+const char* validateOptions[] = { "engines", "reference", "cases", "threads", "ensemble", "tol", "tol_pos", "tol_vel", "tol_mass", "tol_drift" };
+
+// Fixed inputs: the five positional arguments of the engines. The parallel engines add the forces in another
+// order with more threads, and the merges of close objects grow that round-off quickly, so the cases with
+// survivors only run a few steps
+struct Case {
+    const char* name;
+    const char* arguments;
+};
+const Case allCases[] = {
+    { "spread", "1000 50 31728674 1000000 0.01" },   // no collisions
+    { "collide", "2000 20 31728674 100 0.01" },      // small enclosure, almost every object merges
+    { "merge", "3000 30 31728674 1000 0.1" },        // more objects and a larger time step
+    { "small", "50 500 5 10 0.1" },                  // few objects, many steps
+    { "survive", "1000 5 7 100000 1" },              // merges in most steps, 749 objects are left
+    { "sparse", "3000 8 11 300000 1" },              // a few merges in every step, 2968 objects are left
+};
+
+// Final objects, telemetry and execution time of one engine run. sim-ensemble has no telemetry, and the final
+// objects of its simulation k in lanes[k]
+struct Run {
+    int exitCode = 0;
+    double ms = 0;
+    Config config;
+    std::vector<Config> lanes;
+    std::vector<std::vector<double>> telemetry;
+};
+
+std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+// The arguments of a case with the seed increased by k
+std::string withSeed(const std::string& arguments, const size_t k) {
+    std::stringstream stream(arguments);
+    std::string objects, iterations, seed, rest;
+    stream >> objects >> iterations >> seed;
+    std::getline(stream, rest);
+    return objects + " " + iterations + " " + std::to_string(std::stoull(seed) + k) + rest;
+}
+
+// Runs engine on the case in the current directory. sim-ensemble runs the case for the seeds seed, ...,
+// seed + simulations - 1
+Run runEngine(const std::filesystem::path& directory, const std::string& engine, const std::string& arguments, const std::vector<std::string>& engineArgs,
+              const size_t simulations) {
+    Run run;
+    const bool ensemble = engine == "ensemble";
+    std::string command = quote(engineExecutable(directory, engine).string());
+    command.append(" ").append(arguments);
+    for (const std::string& arg : engineArgs) {
+        command.append(" ").append(quote(arg));
+    }
+    command.append(" en_benchmark en_exact_config");
+    command.append(ensemble ? " ensemble=" + std::to_string(simulations) : " telemetry=telemetry.csv");
+    std::filesystem::remove("final_config.txt");
+    std::filesystem::remove("telemetry.csv");
+    for (size_t k = 0; ensemble && k < simulations; k++) {
+        std::filesystem::remove("final_config_" + std::to_string(k) + ".txt");
+    }
+
+    // en_benchmark prints the time last (debug builds print the steps before it)
+    std::string output;
+    run.exitCode = runCapture(command, &output);
+    if (run.exitCode != 0) {
+        return run;
+    }
+    run.ms = std::stod(output.substr(output.find_last_of('\n') + 1));
+    if (ensemble) {
+        run.lanes.resize(simulations);
+        for (size_t k = 0; k < simulations && run.exitCode == 0; k++) {
+            const std::string error = loadConfig("final_config_" + std::to_string(k) + ".txt", run.lanes[k]);
+            if (!error.empty()) {
+                std::cerr << "Error: " << error << "\n";
+                run.exitCode = -3;
+            }
+        }
+        return run;
+    }
+    const std::string error = loadConfig("final_config.txt", run.config);
+    if (!error.empty()) {
+        std::cerr << "Error: " << error << "\n";
+        run.exitCode = -3;
+    }
+    run.telemetry = readTelemetry("telemetry.csv");
+    return run;
+}
+
+// Largest difference of a field, relative to the largest value of that field (the engines write the final
+// objects at full precision, en_exact_config)
+double fieldError(const std::vector<double>& a, const std::vector<double>& b) {
+    double error = 0, scale = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        error = std::max(error, std::abs(a[i] - b[i]));
+        scale = std::max({ scale, std::abs(a[i]), std::abs(b[i]) });
+    }
+    return scale > 0 ? error / scale : 0;
+}
+
+// Largest errors of the fields of the final objects (only when the number of objects is the same)
+struct Errors {
+    bool sameObjects = true;
+    double pos = 0;
+    double vel = 0;
+    double mass = 0;
+};
+Errors compareConfigs(const Config& config, const Config& reference) {
+    Errors errors;
+    if (config.size() != reference.size()) {
+        errors.sameObjects = false;
+        return errors;
+    }
+    errors.pos = std::max({ fieldError(config.x, reference.x), fieldError(config.y, reference.y), fieldError(config.z, reference.z) });
+    errors.vel = std::max({ fieldError(config.vx, reference.vx), fieldError(config.vy, reference.vy), fieldError(config.vz, reference.vz) });
+    errors.mass = fieldError(config.mass, reference.mass);
+    return errors;
+}
+
+// Largest change of the momentum of a run since its first step, relative to the largest sum of m|v| (the momentum
+// itself cancels to about 0). The kinetic energy isn't compared, gravity changes it
+double drift(const std::vector<std::vector<double>>& telemetry) {
+    double scale = 0;
+    for (const std::vector<double>& line : telemetry) {
+        scale = std::max(scale, line[9]);
+    }
+    double change = 0;
+    for (const std::vector<double>& line : telemetry) {
+        for (size_t column = 3; column <= 5 && scale > 0; column++) {
+            change = std::max(change, std::abs(line[column] - telemetry[0][column]) / scale);
+        }
+    }
+    return change;
+}
+
+// Runs every engine on fixed inputs and compares the results with a reference engine (sim-aos): the final
+// objects with a tolerance per field, the number of objects and merges of every step, and the drift of the
+// momentum, which may not exceed the drift of the reference. sim-ensemble runs the case for ensemble=W seeds
+// at once, simulation k is compared with the reference run of seed + k. The speedup over the reference is
+// measured in the same run
+int main(int argc, char** argv) {
+    Options options(argc, argv, 1);
+    const std::string reference = options.get("reference", "aos");
+    const double tol = std::stod(options.get("tol", "1e-6"));
+    const double tolPos = options.has("tol_pos") ? std::stod(options.get("tol_pos")) : tol;
+    const double tolVel = options.has("tol_vel") ? std::stod(options.get("tol_vel")) : tol;
+    const double tolMass = options.has("tol_mass") ? std::stod(options.get("tol_mass")) : tol;
+    const double tolDrift = options.has("tol_drift") ? std::stod(options.get("tol_drift")) : tol;
+    if (tolPos < 0 || tolVel < 0 || tolMass < 0 || tolDrift < 0) {
+        std::cerr << "Error: Invalid tolerance\n";
+        return -2;
+    }
+    const int simulations = std::stoi(options.get("ensemble", "5"));
+    if (simulations < 1) {
+        std::cerr << "Error: Invalid number of simulations\n";
+        return -2;
+    }
+    if (reference == "ensemble") {
+        std::cerr << "Error: sim-ensemble can't be the reference\n";
+        return -1;
+    }
+    if (options.has("threads")) {
+        const int threads = std::stoi(options.get("threads"));
+        if (threads < 1) {
+            std::cerr << "Error: Invalid number of threads\n";
+            return -2;
+        }
+        setThreads(threads);
+    }
+
+    // The engines are next to sim-validate
+    const std::filesystem::path directory = std::filesystem::absolute(argv[0]).parent_path();
+    std::vector<std::string> engines;
+    for (const std::string& engine : split(options.get("engines", ENGINES))) {
+        if (engine != reference) {
+            engines.push_back(engine);
+        }
+    }
+    std::vector<Case> cases(std::begin(allCases), std::end(allCases));
+    if (options.has("cases")) {
+        cases.clear();
+        for (const std::string& name : split(options.get("cases"))) {
+            auto test = std::find_if(std::begin(allCases), std::end(allCases), [&](const Case& c) { return name == c.name; });
+            if (test == std::end(allCases)) {
+                std::cerr << "Error: Unknown case " << name << "\n";
+                return -1;
+            }
+            cases.push_back(*test);
+        }
+    }
+    std::vector<std::string> engineArgs;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const std::string name = arg.substr(0, arg.find('='));
+        if (std::find_if(std::begin(validateOptions), std::end(validateOptions), [&](const char* option) { return name == option; }) == std::end(validateOptions)) {
+            engineArgs.push_back(arg);
+        }
+    }
+
+    // The engines write their files in a directory of their own
+    const std::filesystem::path workDirectory = std::filesystem::current_path();
+    const std::filesystem::path validateDirectory = std::filesystem::temp_directory_path() / ("sim-validate-" + std::to_string(std::hash<std::string>()(workDirectory.string())));
+    std::filesystem::create_directories(validateDirectory);
+    std::filesystem::current_path(validateDirectory);
+
+    const bool hasEnsemble = std::find(engines.begin(), engines.end(), "ensemble") != engines.end() &&
+                             std::filesystem::exists(engineExecutable(directory, "ensemble"));
+    int failures = 0;
+    for (const Case& test : cases) {
+        std::printf("Case %s: %s\n", test.name, test.arguments);
+
+        // The reference for the seed of the case, and for the other seeds of sim-ensemble
+        std::vector<Run> referenceRuns(hasEnsemble ? simulations : 1);
+        for (size_t k = 0; k < referenceRuns.size(); k++) {
+            referenceRuns[k] = runEngine(directory, reference, withSeed(test.arguments, k), engineArgs, 1);
+            if (referenceRuns[k].exitCode != 0) {
+                std::cerr << "Error: sim-" << reference << " failed with exit code " << referenceRuns[k].exitCode << "\n";
+                std::filesystem::current_path(workDirectory);
+                std::filesystem::remove_all(validateDirectory);
+                return -3;
+            }
+        }
+        const Run& referenceRun = referenceRuns[0];
+        std::printf("  %-8s %10s %8s %8s %10s %10s %10s %10s  %s\n", "engine", "ms", "speedup", "objects", "pos err", "vel err", "mass err", "drift", "result");
+        const double referenceDrift = drift(referenceRun.telemetry);
+        std::printf("  %-8s %10.1f %8.2f %8zu %10s %10s %10s %10.2e  reference\n", reference.c_str(), referenceRun.ms, 1.0, referenceRun.config.size(), "", "",
+                    "", referenceDrift);
+
+        for (const std::string& engine : engines) {
+            if (!std::filesystem::exists(engineExecutable(directory, engine))) {
+                continue;
+            }
+            const Run run = runEngine(directory, engine, test.arguments, engineArgs, simulations);
+            if (run.exitCode != 0) {
+                std::printf("  %-8s FAIL (exit code %d)\n", engine.c_str(), run.exitCode);
+                failures++;
+                continue;
+            }
+
+            // sim-ensemble: the largest errors of its simulations, its time against the reference runs of all seeds
+            std::string result;
+            if (engine == "ensemble") {
+                Errors errors;
+                double referenceMs = 0;
+                for (size_t k = 0; k < run.lanes.size(); k++) {
+                    const Errors lane = compareConfigs(run.lanes[k], referenceRuns[k].config);
+                    errors.sameObjects &= lane.sameObjects;
+                    errors.pos = std::max(errors.pos, lane.pos);
+                    errors.vel = std::max(errors.vel, lane.vel);
+                    errors.mass = std::max(errors.mass, lane.mass);
+                    referenceMs += referenceRuns[k].ms;
+                }
+                result += errors.sameObjects ? "" : " objects";
+                result += errors.pos > tolPos ? " pos" : "";
+                result += errors.vel > tolVel ? " vel" : "";
+                result += errors.mass > tolMass ? " mass" : "";
+                if (!result.empty()) {
+                    failures++;
+                }
+                std::printf("  %-8s %10.1f %8.2f %8zu %10.2e %10.2e %10.2e %10s  %s%s\n", engine.c_str(), run.ms, referenceMs / run.ms, run.lanes[0].size(),
+                            errors.pos, errors.vel, errors.mass, "", result.empty() ? "OK" : "FAIL:", result.c_str());
+                continue;
+            }
+
+            // Same objects and merges in every step, then the fields of the final objects
+            bool sameSteps = run.telemetry.size() == referenceRun.telemetry.size();
+            for (size_t step = 0; sameSteps && step < run.telemetry.size(); step++) {
+                sameSteps = run.telemetry[step][1] == referenceRun.telemetry[step][1] && run.telemetry[step][2] == referenceRun.telemetry[step][2];
+            }
+            const Errors errors = compareConfigs(run.config, referenceRun.config);
+            if (!errors.sameObjects) {
+                result += " objects";
+            } else if (!sameSteps) {
+                result += " merges";
+            }
+            const double runDrift = drift(run.telemetry);
+            if (errors.pos > tolPos) {
+                result += " pos";
+            }
+            if (errors.vel > tolVel) {
+                result += " vel";
+            }
+            if (errors.mass > tolMass) {
+                result += " mass";
+            }
+            if (runDrift > referenceDrift + tolDrift) {
+                result += " drift";
+            }
+            if (!result.empty()) {
+                failures++;
+            }
+            std::printf("  %-8s %10.1f %8.2f %8zu %10.2e %10.2e %10.2e %10.2e  %s%s\n", engine.c_str(), run.ms, referenceRun.ms / run.ms, run.config.size(),
+                        errors.pos, errors.vel, errors.mass, runDrift, result.empty() ? "OK" : "FAIL:", result.c_str());
+        }
+    }
+
+    std::filesystem::current_path(workDirectory);
+    std::filesystem::remove_all(validateDirectory);
+    if (failures > 0) {
+        std::printf("%d failed\n", failures);
+        return -2;
+    }
+    std::printf("All engines match sim-%s\n", reference.c_str());
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../common/config_io.h"
+#include "../common/trajectory.h"
+
+// Prints the frames of a trajectory file (traj=file of the simulators), or the positions of one frame
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: traj-reader file [frame]\n";
+        return -1;
+    }
+
+    TrajectoryReader reader;
+    std::string error = reader.open(argv[1]);
+    if (!error.empty()) {
+        std::cerr << "Error: " << error << "\n";
+        return -3;
+    }
+
+    // Without a frame: the settings and the step of every frame
+    if (argc == 2) {
+        std::printf("Enclosure %.3f, time step %.3f, %u bits, keyframe every %u frames, %zu frames\n",
+                    reader.size_enclosure, reader.time_step, reader.bits, reader.keyframeEvery, reader.frames());
+        for (size_t f = 0; f < reader.frames(); f++) {
+            std::printf("%zu: step %llu\n", f, (unsigned long long)reader.step(f));
+        }
+        return 0;
+    }
+
+    const long long frame = std::stoll(argv[2]);
+    if (frame < 0) {
+        std::cerr << "Error: Invalid frame\n";
+        return -2;
+    }
+    std::vector<double> positions;
+    std::vector<uint64_t> events;
+    error = reader.read((size_t)frame, positions, &events);
+    if (!error.empty()) {
+        std::cerr << "Error: " << error << "\n";
+        return -3;
+    }
+
+    // Header "step objects merges (removed indices)", then "x y z" per object as in the config files
+    std::printf("step %llu, %zu objects, %zu merges", (unsigned long long)reader.step(frame), positions.size() / 3, events.size());
+    for (uint64_t index : events) {
+        std::printf(" %llu", (unsigned long long)index);
+    }
+    std::printf("\n");
+    std::string out;
+    char line[3 * 320];
+    for (size_t i = 0; i < positions.size(); i += 3) {
+        char* p = line;
+        for (int dim = 0; dim < 3; dim++) {
+            p = config_detail::formatNumber(p, line + sizeof(line), positions[i + dim]);
+            *p++ = dim < 2 ? ' ' : '\n';
+        }
+        out.append(line, p);
+    }
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    return 0;
+}